@@ -0,0 +1,546 @@
+// Runs the solver over a set of instances and thread counts, records the counters of each run, and compares the
+//   medians against a saved baseline. Portable C++: the solver is launched with std::system().
+// Small generated instances with known answers check the preprocessing: a wrong answer, or a model which doesn't
+//   satisfy the original clauses, e.g. after a faulty reconstruction of the removed variables, fails the run.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct RunResult {
+  string _instance;
+  int64_t _nThreads = 0;
+  int64_t _iRep = 0;
+  string _result;
+  double _wallSec = 0;
+  int64_t _nNodes = 0;
+  double _probesPerSec = 0;
+  double _applyVarPerSec = 0;
+  double _peakRssMb = 0;
+  int64_t _frontierHighWater = 0;
+};
+
+struct Options {
+  string _solver = "MaxElim.exe";
+  // Appended to the command line of each run, e.g. to compare the options of the solver.
+  string _solverArgs;
+  string _dataDir = "../Data";
+  string _workDir = ".";
+  vector<string> _instances = { "inputSmall", "inputMain", "input", "inputLarge" };
+  // The generated instances as (variable count, seed).
+  vector<pair<int64_t, int64_t>> _generated;
+  // The number of the satisfiable and of the unsatisfiable instances for checking the preprocessing, each.
+  int64_t _nChecks = 2;
+  vector<int64_t> _threadCounts = { 1 };
+  int64_t _nReps = 3;
+  string _outFn = "bench_results.tsv";
+  string _baselineFn;
+  // The relative slowdown of the median wall time which counts as a regression.
+  double _tolerance = 0.10;
+  // The wall times below which the process startup dominates, so that the ratio isn't judged.
+  double _minSec = 0.05;
+};
+
+const char* const gcHeader = "instance\tthreads\trep\tresult\twall_sec\tnodes\tprobes_per_sec\tapply_var_per_sec"
+  "\tpeak_rss_mb\tfrontier_high_water";
+
+void PrintUsage() {
+  fprintf(stderr, "Usage: Bench [--solver <MaxElim.exe>] [--solver-args <\"options\">] [--data <dir>] [--work <dir>]"
+    " [--instances <name,name,...>] [--gen <nVars>:<seed>]... [--checks <n>] [--threads <n,n,...>] [--reps <n>]"
+    " [--out <results.tsv>] [--baseline <baseline.tsv>] [--tolerance <fraction>] [--min-sec <seconds>]\n");
+}
+
+vector<string> Split(const string &s, const char delim) {
+  vector<string> ans;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, delim)) {
+    if (!item.empty()) {
+      ans.push_back(item);
+    }
+  }
+  return ans;
+}
+
+// Returns |false| if the arguments are malformed.
+bool ParseOptions(int argc, char *argv[], Options &opts) {
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const string key = argv[i];
+    const string value = argv[++i];
+    if (key == "--solver") {
+      opts._solver = value;
+    }
+    else if (key == "--solver-args") {
+      opts._solverArgs = value;
+    }
+    else if (key == "--data") {
+      opts._dataDir = value;
+    }
+    else if (key == "--work") {
+      opts._workDir = value;
+    }
+    else if (key == "--instances") {
+      opts._instances = Split(value, ',');
+    }
+    else if (key == "--gen") {
+      const vector<string> parts = Split(value, ':');
+      if (parts.size() != 2) {
+        return false;
+      }
+      opts._generated.emplace_back(atoll(parts[0].c_str()), atoll(parts[1].c_str()));
+    }
+    else if (key == "--checks") {
+      opts._nChecks = atoll(value.c_str());
+    }
+    else if (key == "--threads") {
+      opts._threadCounts.clear();
+      for (const string &s : Split(value, ',')) {
+        opts._threadCounts.push_back(atoll(s.c_str()));
+      }
+    }
+    else if (key == "--reps") {
+      opts._nReps = atoll(value.c_str());
+    }
+    else if (key == "--out") {
+      opts._outFn = value;
+    }
+    else if (key == "--baseline") {
+      opts._baselineFn = value;
+    }
+    else if (key == "--tolerance") {
+      opts._tolerance = atof(value.c_str());
+    }
+    else if (key == "--min-sec") {
+      opts._minSec = atof(value.c_str());
+    }
+    else {
+      return false;
+    }
+  }
+  return !opts._threadCounts.empty() && opts._nReps > 0;
+}
+
+// Writes a uniform random 3-SAT instance at the clause-to-variable ratio of the satisfiability threshold.
+string GenerateInstance(const Options &opts, const int64_t nVars, const int64_t seed) {
+  const int64_t nClauses = int64_t(nVars * 4.26);
+  const string fn = opts._workDir + "/gen" + to_string(nVars) + "_" + to_string(seed) + ".3cnf";
+  mt19937_64 rng(seed);
+  uniform_int_distribution<int64_t> varDist(1, nVars);
+  FILE *fp = fopen(fn.c_str(), "wt");
+  if (fp == nullptr) {
+    fprintf(stderr, "Cannot write %s\n", fn.c_str());
+    exit(2);
+  }
+  fprintf(fp, "p cnf %lld %lld\n", (long long)nVars, (long long)nClauses);
+  for (int64_t i = 0; i < nClauses; i++) {
+    int64_t vars[3];
+    for (int8_t j = 0; j < 3; j++) {
+      bool unique;
+      do {
+        vars[j] = varDist(rng);
+        unique = true;
+        for (int8_t k = 0; k < j; k++) {
+          unique = unique && (vars[k] != vars[j]);
+        }
+      } while (!unique);
+      fprintf(fp, "%lld ", (long long)((rng() & 1) ? vars[j] : -vars[j]));
+    }
+    fprintf(fp, "0\n");
+  }
+  fclose(fp);
+  return fn;
+}
+
+// An instance with a known answer, and its clauses to check the models against.
+struct CheckInstance {
+  string _name;
+  string _fn;
+  bool _bSat = true;
+  vector<vector<int64_t>> _clauses;
+};
+
+// Writes a small instance which the preprocessing simplifies with each of its techniques: random 3-clauses
+//   satisfied by a planted assignment, variables equivalent to others, definitions z = a & b used in a single
+//   clause, which get eliminated, and pairs of clauses strengthening each other. An unsatisfiable instance adds a
+//   contradiction found by the substitution of the equivalences for an even seed, or by the strengthening for an
+//   odd one.
+CheckInstance GenerateCheckInstance(const Options &opts, const bool bSat, const int64_t seed) {
+  const int64_t nBase = 40;
+  CheckInstance ci;
+  ci._name = string(bSat ? "pre_sat_" : "pre_unsat_") + to_string(seed);
+  ci._fn = opts._workDir + "/" + ci._name + ".3cnf";
+  ci._bSat = bSat;
+  mt19937_64 rng(seed * 2 + (bSat ? 0 : 1));
+  vector<bool> planted(nBase + 1);
+  for (int64_t i = 1; i <= nBase; i++) {
+    planted[i] = (rng() & 1);
+  }
+  const auto newVar = [&](const bool value) {
+    planted.push_back(value);
+    return int64_t(planted.size()) - 1;
+  };
+  const auto isTrue = [&](const int64_t lit) { return planted[abs(lit)] == (lit > 0); };
+  const auto randomLit = [&]() {
+    const int64_t var = 1 + int64_t(rng() % (planted.size() - 1));
+    return (rng() & 1) ? var : -var;
+  };
+  // A clause of |lit| and |nMore| random literals over distinct variables, satisfied by the planted assignment.
+  const auto plantedClause = [&](const int64_t lit, const int64_t nMore) {
+    vector<int64_t> cl;
+    do {
+      cl.assign(1, lit);
+      while (int64_t(cl.size()) < nMore + 1) {
+        const int64_t next = randomLit();
+        bool unique = true;
+        for (const int64_t other : cl) {
+          unique = unique && (abs(other) != abs(next));
+        }
+        if (unique) {
+          cl.push_back(next);
+        }
+      }
+    } while (none_of(cl.begin(), cl.end(), isTrue));
+    return cl;
+  };
+  const auto addPlanted = [&](const int64_t lit, const int64_t nMore) {
+    ci._clauses.push_back(plantedClause(lit, nMore));
+  };
+  // The 2-clauses making |var| equal to |lit|.
+  const auto addEquiv = [&](const int64_t var, const int64_t lit) {
+    ci._clauses.push_back({ -var, lit });
+    ci._clauses.push_back({ var, -lit });
+  };
+
+  for (int64_t i = 0; i < 3 * nBase; i++) {
+    addPlanted(randomLit(), 2);
+  }
+  for (int64_t i = 0; i < 12; i++) {
+    const int64_t lit = randomLit();
+    const int64_t var = newVar(isTrue(lit));
+    addEquiv(var, lit);
+    addPlanted((rng() & 1) ? var : -var, 2);
+    addPlanted((rng() & 1) ? var : -var, 2);
+  }
+  for (int64_t i = 0; i < 8; i++) {
+    const int64_t a = randomLit();
+    int64_t b;
+    do {
+      b = randomLit();
+    } while (abs(b) == abs(a));
+    const int64_t z = newVar(isTrue(a) && isTrue(b));
+    ci._clauses.push_back({ -z, a });
+    ci._clauses.push_back({ -z, b });
+    ci._clauses.push_back({ z, -a, -b });
+    addPlanted((rng() & 1) ? z : -z, 1);
+  }
+  for (int64_t i = 0; i < 8; i++) {
+    // The pair is resolved on its last variable into the first two literals, which the planted assignment
+    //   satisfies.
+    vector<int64_t> cl;
+    do {
+      cl = plantedClause(randomLit(), 2);
+    } while (!isTrue(cl[0]) && !isTrue(cl[1]));
+    ci._clauses.push_back(cl);
+    ci._clauses.push_back({ cl[0], cl[1], -cl[2] });
+  }
+  if (!bSat) {
+    if (seed % 2 == 0) {
+      // A chain of equivalences from a literal to its negation.
+      const int64_t lit = randomLit();
+      int64_t prev = lit;
+      for (int64_t i = 0; i < 3; i++) {
+        const int64_t var = newVar(false);
+        addEquiv(var, prev);
+        prev = var;
+      }
+      addEquiv(prev, -lit);
+    }
+    else {
+      // z is strengthened to both 1-clauses z and -z.
+      const int64_t z = newVar(false);
+      const int64_t p = newVar(false);
+      const int64_t q = newVar(false);
+      ci._clauses.push_back({ z, p });
+      ci._clauses.push_back({ z, -p });
+      ci._clauses.push_back({ -z, q });
+      ci._clauses.push_back({ -z, -q });
+    }
+  }
+  shuffle(ci._clauses.begin(), ci._clauses.end(), rng);
+
+  FILE *fp = fopen(ci._fn.c_str(), "wt");
+  if (fp == nullptr) {
+    fprintf(stderr, "Cannot write %s\n", ci._fn.c_str());
+    exit(2);
+  }
+  fprintf(fp, "p cnf %lld %lld\n", (long long)(planted.size() - 1), (long long)ci._clauses.size());
+  for (const vector<int64_t> &cl : ci._clauses) {
+    for (const int64_t lit : cl) {
+      fprintf(fp, "%lld ", (long long)lit);
+    }
+    fprintf(fp, "0\n");
+  }
+  fclose(fp);
+  return ci;
+}
+
+// Returns an empty string if the run answered as expected with a model satisfying all the clauses, otherwise the
+//   reason.
+string CheckAnswer(const CheckInstance &ci, const RunResult &rr, const string &outFn) {
+  const string expected = ci._bSat ? "SAT" : "UNSAT";
+  if (rr._result != expected) {
+    return "answered " + rr._result + " instead of " + expected;
+  }
+  if (!ci._bSat) {
+    return "";
+  }
+  ifstream ifs(outFn);
+  string line;
+  getline(ifs, line);
+  stringstream ss(line);
+  vector<bool> model(1);
+  int value;
+  while (ss >> value) {
+    model.push_back(value != 0);
+  }
+  for (size_t i = 0; i < ci._clauses.size(); i++) {
+    bool bSatisfied = false;
+    for (const int64_t lit : ci._clauses[i]) {
+      bSatisfied = bSatisfied || (abs(lit) < int64_t(model.size()) && model[abs(lit)] == (lit > 0));
+    }
+    if (!bSatisfied) {
+      return "the model violates clause " + to_string(i);
+    }
+  }
+  return "";
+}
+
+map<string, string> ReadKeyValues(const string &fn) {
+  map<string, string> ans;
+  ifstream ifs(fn);
+  string line;
+  while (getline(ifs, line)) {
+    const size_t at = line.find('=');
+    if (at != string::npos) {
+      ans[line.substr(0, at)] = line.substr(at + 1);
+    }
+  }
+  return ans;
+}
+
+string OutputFn(const Options &opts) {
+  return opts._workDir + "/bench_output.txt";
+}
+
+RunResult RunOnce(const Options &opts, const string &name, const string &inputFn, const int64_t nThreads,
+  const int64_t iRep)
+{
+  const string outFn = OutputFn(opts);
+  const string statsFn = opts._workDir + "/bench_stats.txt";
+  remove(statsFn.c_str());
+  const string cmd = "\"" + opts._solver + "\" --input \"" + inputFn + "\" --output \"" + outFn + "\" --threads "
+    + to_string(nThreads) + " --stats \"" + statsFn + "\"" + (opts._solverArgs.empty() ? "" : " " + opts._solverArgs);
+  const auto tStart = chrono::steady_clock::now();
+  const int exitCode = system(cmd.c_str());
+  const double wallSec = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+
+  RunResult rr;
+  rr._instance = name;
+  rr._nThreads = nThreads;
+  rr._iRep = iRep;
+  rr._wallSec = wallSec;
+  map<string, string> stats = ReadKeyValues(statsFn);
+  if (exitCode != 0 || stats.count("result") == 0) {
+    fprintf(stderr, "The solver failed on %s with exit code %d\n", inputFn.c_str(), exitCode);
+    rr._result = "ERROR";
+    return rr;
+  }
+  rr._result = stats["result"];
+  rr._nNodes = atoll(stats["nodes"].c_str());
+  const double solverSec = max(atof(stats["wall_sec"].c_str()), 1e-9);
+  rr._probesPerSec = atof(stats["probes"].c_str()) / solverSec;
+  rr._applyVarPerSec = atof(stats["apply_var"].c_str()) / solverSec;
+  rr._peakRssMb = atof(stats["peak_rss_bytes"].c_str()) / (1 << 20);
+  rr._frontierHighWater = atoll(stats["frontier_high_water"].c_str());
+  return rr;
+}
+
+void WriteResult(FILE *fp, const RunResult &rr) {
+  fprintf(fp, "%s\t%lld\t%lld\t%s\t%.6f\t%lld\t%.1f\t%.1f\t%.2f\t%lld\n", rr._instance.c_str(),
+    (long long)rr._nThreads, (long long)rr._iRep, rr._result.c_str(), rr._wallSec, (long long)rr._nNodes,
+    rr._probesPerSec, rr._applyVarPerSec, rr._peakRssMb, (long long)rr._frontierHighWater);
+}
+
+vector<RunResult> ReadResults(const string &fn) {
+  vector<RunResult> ans;
+  ifstream ifs(fn);
+  string line;
+  getline(ifs, line); // header
+  while (getline(ifs, line)) {
+    vector<string> cols;
+    stringstream ss(line);
+    string col;
+    while (getline(ss, col, '\t')) {
+      cols.push_back(col);
+    }
+    if (cols.size() < 10) {
+      continue;
+    }
+    RunResult rr;
+    rr._instance = cols[0];
+    rr._nThreads = atoll(cols[1].c_str());
+    rr._iRep = atoll(cols[2].c_str());
+    rr._result = cols[3];
+    rr._wallSec = atof(cols[4].c_str());
+    rr._nNodes = atoll(cols[5].c_str());
+    rr._probesPerSec = atof(cols[6].c_str());
+    rr._applyVarPerSec = atof(cols[7].c_str());
+    rr._peakRssMb = atof(cols[8].c_str());
+    rr._frontierHighWater = atoll(cols[9].c_str());
+    ans.push_back(rr);
+  }
+  return ans;
+}
+
+// The runs grouped by instance and thread count.
+typedef map<pair<string, int64_t>, vector<RunResult>> TGroups;
+
+TGroups Group(const vector<RunResult> &results) {
+  TGroups ans;
+  for (const RunResult &rr : results) {
+    ans[make_pair(rr._instance, rr._nThreads)].push_back(rr);
+  }
+  return ans;
+}
+
+double MedianWall(const vector<RunResult> &runs) {
+  vector<double> walls;
+  for (const RunResult &rr : runs) {
+    walls.push_back(rr._wallSec);
+  }
+  sort(walls.begin(), walls.end());
+  const size_t n = walls.size();
+  return (n % 2 == 1) ? walls[n / 2] : (walls[n / 2 - 1] + walls[n / 2]) / 2;
+}
+
+// Returns the number of regressions.
+int64_t CompareToBaseline(const Options &opts, const vector<RunResult> &current) {
+  const vector<RunResult> baseline = ReadResults(opts._baselineFn);
+  if (baseline.empty()) {
+    fprintf(stderr, "No baseline results in %s\n", opts._baselineFn.c_str());
+    return 0;
+  }
+  const TGroups baseGroups = Group(baseline);
+  const TGroups curGroups = Group(current);
+  int64_t nRegressions = 0;
+  printf("%-24s %8s %12s %12s %8s  %s\n", "instance", "threads", "base_sec", "cur_sec", "ratio", "verdict");
+  for (const auto &cur : curGroups) {
+    const auto itBase = baseGroups.find(cur.first);
+    if (itBase == baseGroups.end()) {
+      printf("%-24s %8lld %12s %12.3f %8s  new\n", cur.first.first.c_str(), (long long)cur.first.second, "-",
+        MedianWall(cur.second), "-");
+      continue;
+    }
+    const double baseSec = MedianWall(itBase->second);
+    const double curSec = MedianWall(cur.second);
+    const double ratio = curSec / max(baseSec, 1e-9);
+    const char *verdict = "ok";
+    if (cur.second.front()._result != itBase->second.front()._result) {
+      verdict = "RESULT MISMATCH";
+      nRegressions++;
+    }
+    else if (max(baseSec, curSec) < opts._minSec) {
+      verdict = "too short";
+    }
+    else if (ratio > 1 + opts._tolerance) {
+      verdict = "REGRESSION";
+      nRegressions++;
+    }
+    else if (ratio < 1 - opts._tolerance) {
+      verdict = "faster";
+    }
+    printf("%-24s %8lld %12.3f %12.3f %8.3f  %s\n", cur.first.first.c_str(), (long long)cur.first.second, baseSec,
+      curSec, ratio, verdict);
+  }
+  return nRegressions;
+}
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  if (!ParseOptions(argc, argv, opts)) {
+    PrintUsage();
+    return 1;
+  }
+
+  vector<pair<string, string>> instances; // name, file
+  for (const string &name : opts._instances) {
+    instances.emplace_back(name, opts._dataDir + "/" + name + ".3cnf");
+  }
+  for (const auto &gen : opts._generated) {
+    const string fn = GenerateInstance(opts, gen.first, gen.second);
+    instances.emplace_back("gen" + to_string(gen.first) + "_" + to_string(gen.second), fn);
+  }
+  map<string, CheckInstance> checks;
+  for (int64_t seed = 1; seed <= opts._nChecks; seed++) {
+    for (const bool bSat : { true, false }) {
+      CheckInstance ci = GenerateCheckInstance(opts, bSat, seed);
+      instances.emplace_back(ci._name, ci._fn);
+      checks[ci._name] = std::move(ci);
+    }
+  }
+
+  FILE *fpOut = fopen(opts._outFn.c_str(), "wt");
+  if (fpOut == nullptr) {
+    fprintf(stderr, "Cannot write %s\n", opts._outFn.c_str());
+    return 2;
+  }
+  fprintf(fpOut, "%s\n", gcHeader);
+  vector<RunResult> results;
+  int64_t nWrong = 0;
+  for (const auto &inst : instances) {
+    for (const int64_t nThreads : opts._threadCounts) {
+      for (int64_t iRep = 0; iRep < opts._nReps; iRep++) {
+        const RunResult rr = RunOnce(opts, inst.first, inst.second, nThreads, iRep);
+        WriteResult(fpOut, rr);
+        fflush(fpOut);
+        WriteResult(stdout, rr);
+        results.push_back(rr);
+        const auto itCheck = checks.find(inst.first);
+        if (itCheck != checks.end()) {
+          const string failure = CheckAnswer(itCheck->second, rr, OutputFn(opts));
+          if (!failure.empty()) {
+            printf("WRONG ANSWER on %s with %lld threads: %s\n", inst.first.c_str(), (long long)nThreads,
+              failure.c_str());
+            nWrong++;
+          }
+        }
+      }
+    }
+  }
+  fclose(fpOut);
+  if (nWrong > 0) {
+    printf("%lld wrong answer(s)\n", (long long)nWrong);
+    return 4;
+  }
+
+  if (!opts._baselineFn.empty()) {
+    const int64_t nRegressions = CompareToBaseline(opts, results);
+    if (nRegressions > 0) {
+      printf("%lld regression(s) against %s\n", (long long)nRegressions, opts._baselineFn.c_str());
+      return 3;
+    }
+  }
+  return 0;
+}
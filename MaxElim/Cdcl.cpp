@@ -0,0 +1,459 @@
+#include "stdafx.h"
+#include "Cdcl.h"
+#include "Stats.h"
+
+bool Cdcl::locked(const int64_t cref) {
+  const int64_t first = litsOf(cref)[0];
+  return _value[first] == 1 && _reason[varOf(first)] == cref;
+}
+
+void Cdcl::heapUp(int64_t at) {
+  const int64_t var = _heap[at];
+  while (at > 0) {
+    const int64_t parent = (at - 1) >> 1;
+    if (_activity[_heap[parent]] >= _activity[var]) {
+      break;
+    }
+    _heap[at] = _heap[parent];
+    _heapPos[_heap[at]] = at;
+    at = parent;
+  }
+  _heap[at] = var;
+  _heapPos[var] = at;
+}
+
+void Cdcl::heapDown(int64_t at) {
+  const int64_t var = _heap[at];
+  const int64_t n = int64_t(_heap.size());
+  for (;;) {
+    int64_t child = 2 * at + 1;
+    if (child >= n) {
+      break;
+    }
+    if (child + 1 < n && _activity[_heap[child + 1]] > _activity[_heap[child]]) {
+      child++;
+    }
+    if (_activity[_heap[child]] <= _activity[var]) {
+      break;
+    }
+    _heap[at] = _heap[child];
+    _heapPos[_heap[at]] = at;
+    at = child;
+  }
+  _heap[at] = var;
+  _heapPos[var] = at;
+}
+
+void Cdcl::heapInsert(const int64_t var) {
+  if (_heapPos[var] >= 0) {
+    return;
+  }
+  _heap.push_back(var);
+  heapUp(int64_t(_heap.size()) - 1);
+}
+
+int64_t Cdcl::heapPopMax() {
+  const int64_t ans = _heap[0];
+  _heapPos[ans] = -1;
+  const int64_t last = _heap.back();
+  _heap.pop_back();
+  if (!_heap.empty()) {
+    _heap[0] = last;
+    heapDown(0);
+  }
+  return ans;
+}
+
+void Cdcl::bumpVar(const int64_t var) {
+  _activity[var] += _varInc;
+  if (_activity[var] > 1e100) {
+    for (int64_t i = 1; i <= _nVars; i++) {
+      _activity[i] *= 1e-100;
+    }
+    _varInc *= 1e-100;
+  }
+  if (_heapPos[var] >= 0) {
+    heapUp(_heapPos[var]);
+  }
+}
+
+void Cdcl::enqueue(const int64_t lit, const int64_t reason) {
+  const int64_t var = varOf(lit);
+  _value[lit] = 1;
+  _value[negOf(lit)] = -1;
+  _level[var] = decisionLevel();
+  _reason[var] = reason;
+  _trail.push_back(lit);
+}
+
+int64_t Cdcl::propagate() {
+  int64_t confl = -1;
+  while (_qHead < int64_t(_trail.size())) {
+    const int64_t falseLit = negOf(_trail[_qHead++]);
+    std::vector<Watch> &ws = _watches[falseLit];
+    const int64_t nWs = int64_t(ws.size());
+    int64_t i = 0, j = 0;
+    while (i < nWs) {
+      const Watch w = ws[i++];
+      if (_value[w._blocker] == 1) {
+        ws[j++] = w;
+        continue;
+      }
+      int64_t *pLits = litsOf(w._cref);
+      if (pLits[0] == falseLit) {
+        std::swap(pLits[0], pLits[1]);
+      }
+      const int64_t first = pLits[0];
+      if (first != w._blocker && _value[first] == 1) {
+        ws[j++] = Watch{ w._cref, first };
+        continue;
+      }
+      //// Look for a new literal to watch
+      const int64_t size = _arena[w._cref + _cHdrSize];
+      bool bMoved = false;
+      for (int64_t k = 2; k < size; k++) {
+        if (_value[pLits[k]] != -1) {
+          pLits[1] = pLits[k];
+          pLits[k] = falseLit;
+          _watches[pLits[1]].push_back(Watch{ w._cref, first });
+          bMoved = true;
+          break;
+        }
+      }
+      if (bMoved) {
+        continue;
+      }
+      //// The clause is unit or conflicting
+      ws[j++] = Watch{ w._cref, first };
+      if (_value[first] == -1) {
+        confl = w._cref;
+        while (i < nWs) {
+          ws[j++] = ws[i++];
+        }
+        _qHead = int64_t(_trail.size());
+        break;
+      }
+      enqueue(first, w._cref);
+    }
+    ws.resize(j);
+  }
+  return confl;
+}
+
+// Whether the literal of the learned clause is implied by the others, judging by its reason clause only.
+bool Cdcl::redundant(const int64_t lit) {
+  const int64_t reason = _reason[varOf(lit)];
+  if (reason < 0) {
+    return false;
+  }
+  const int64_t *pLits = litsOf(reason);
+  const int64_t size = _arena[reason + _cHdrSize];
+  for (int64_t k = 1; k < size; k++) {
+    const int64_t var = varOf(pLits[k]);
+    if (!_seen[var] && _level[var] > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Cdcl::analyze(int64_t confl, int64_t &btLevel, int64_t &lbd) {
+  _learnt.clear();
+  _learnt.push_back(-1); // the asserting literal
+  _toClear.clear();
+  int64_t nAtLevel = 0;
+  int64_t lit = -1;
+  int64_t iTrail = int64_t(_trail.size()) - 1;
+  do {
+    const int64_t *pLits = litsOf(confl);
+    const int64_t size = _arena[confl + _cHdrSize];
+    // The first literal of a reason clause is the one it implied.
+    for (int64_t k = (lit == -1 ? 0 : 1); k < size; k++) {
+      const int64_t var = varOf(pLits[k]);
+      if (_seen[var] || _level[var] == 0) {
+        continue;
+      }
+      bumpVar(var);
+      _seen[var] = 1;
+      _toClear.push_back(var);
+      if (_level[var] >= decisionLevel()) {
+        nAtLevel++;
+      }
+      else {
+        _learnt.push_back(pLits[k]);
+      }
+    }
+    while (!_seen[varOf(_trail[iTrail])]) {
+      iTrail--;
+    }
+    lit = _trail[iTrail];
+    iTrail--;
+    confl = _reason[varOf(lit)];
+    nAtLevel--;
+  } while (nAtLevel > 0);
+  _learnt[0] = negOf(lit);
+
+  //// Drop the literals implied by the rest, then find the backjump level and the LBD
+  int64_t nKept = 1;
+  for (int64_t i = 1; i < int64_t(_learnt.size()); i++) {
+    if (!redundant(_learnt[i])) {
+      _learnt[nKept++] = _learnt[i];
+    }
+  }
+  _learnt.resize(nKept);
+  for (int64_t i = 0; i < int64_t(_toClear.size()); i++) {
+    _seen[_toClear[i]] = 0;
+  }
+
+  btLevel = 0;
+  for (int64_t i = 1; i < nKept; i++) {
+    if (_level[varOf(_learnt[i])] > btLevel) {
+      btLevel = _level[varOf(_learnt[i])];
+      std::swap(_learnt[1], _learnt[i]);
+    }
+  }
+  _lbdEpoch++;
+  lbd = 0;
+  for (int64_t i = 0; i < nKept; i++) {
+    const int64_t level = _level[varOf(_learnt[i])];
+    if (_levelStamp[level] != _lbdEpoch) {
+      _levelStamp[level] = _lbdEpoch;
+      lbd++;
+    }
+  }
+}
+
+void Cdcl::backtrack(const int64_t level) {
+  if (decisionLevel() <= level) {
+    return;
+  }
+  for (int64_t i = int64_t(_trail.size()) - 1; i >= _trailLim[level]; i--) {
+    const int64_t lit = _trail[i];
+    const int64_t var = varOf(lit);
+    _phase[var] = (lit & 1) == 0;
+    _value[lit] = 0;
+    _value[negOf(lit)] = 0;
+    _reason[var] = -1;
+    heapInsert(var);
+  }
+  _trail.resize(_trailLim[level]);
+  _trailLim.resize(level);
+  _qHead = int64_t(_trail.size());
+}
+
+int64_t Cdcl::allocClause(const int64_t *pLits, const int64_t nLits, const int64_t lbd) {
+  const int64_t cref = int64_t(_arena.size());
+  _arena.push_back(nLits);
+  _arena.push_back(lbd);
+  _arena.push_back(-1);
+  _arena.insert(_arena.end(), pLits, pLits + nLits);
+  _watches[pLits[0]].push_back(Watch{ cref, pLits[1] });
+  _watches[pLits[1]].push_back(Watch{ cref, pLits[0] });
+  return cref;
+}
+
+void Cdcl::addClause(std::vector<int64_t> &lits) {
+  if (_bUnsat) {
+    return;
+  }
+  std::sort(lits.begin(), lits.end());
+  int64_t nKept = 0;
+  for (int64_t i = 0; i < int64_t(lits.size()); i++) {
+    const int64_t lit = lits[i];
+    if (_value[lit] == 1 || (i > 0 && lits[i - 1] == negOf(lit))) {
+      return; // satisfied or tautological
+    }
+    if (_value[lit] == -1 || (i > 0 && lits[i - 1] == lit)) {
+      continue;
+    }
+    lits[nKept++] = lit;
+  }
+  lits.resize(nKept);
+  switch (nKept) {
+  case 0:
+    _bUnsat = true;
+    return;
+  case 1:
+    enqueue(lits[0], -1);
+    _bUnsat = (propagate() >= 0);
+    return;
+  default:
+    _originals.push_back(allocClause(lits.data(), nKept, 0));
+    return;
+  }
+}
+
+template<typename TIdx> void Cdcl::Load(const Problem<TIdx> &prob) {
+  _nVars = prob._varVal.size() - 1;
+  _watches.assign(2 * (_nVars + 1), std::vector<Watch>());
+  _value.assign(2 * (_nVars + 1), 0);
+  _level.assign(_nVars + 1, 0);
+  _reason.assign(_nVars + 1, -1);
+  _activity.assign(_nVars + 1, 0);
+  _heapPos.assign(_nVars + 1, -1);
+  _phase.assign(_nVars + 1, false);
+  _seen.assign(_nVars + 1, 0);
+  _levelStamp.assign(_nVars + 1, 0);
+  for (int64_t i = 1; i <= _nVars; i++) {
+    if (!prob._varKnown[i]) {
+      _phase[i] = prob._model2[i];
+      heapInsert(i);
+    }
+  }
+
+  std::vector<int64_t> lits;
+  for (int64_t i = 0; i < prob._cl3.size(); i++) {
+    lits.clear();
+    for (int8_t j = 0; j < 3; j++) {
+      if (prob._cl3[i]._vars[j] != 0) {
+        lits.push_back(litOf(prob._cl3[i]._vars[j]));
+      }
+    }
+    addClause(lits);
+  }
+  for (int64_t i = 0; i < prob._cl2.size(); i++) {
+    lits.assign({ litOf(prob._cl2[i]._vars[0]), litOf(prob._cl2[i]._vars[1]) });
+    addClause(lits);
+  }
+  for (int64_t i = 0; i < prob._clk.size(); i++) {
+    lits.clear();
+    for (int64_t j = 0; j < prob._clk[i]._size; j++) {
+      lits.push_back(litOf(prob.LitK(i, j)));
+    }
+    addClause(lits);
+  }
+  _maxLearnts = std::max<int64_t>(int64_t(_originals.size()) / 3, 2000);
+}
+
+void Cdcl::reduceLearnts() {
+  // Delete the half of the learned clauses with the highest LBD, preferring to keep the recent ones.
+  std::stable_sort(_learnts.begin(), _learnts.end(), [this](const int64_t a, const int64_t b) {
+    return _arena[a + _cHdrLbd] > _arena[b + _cHdrLbd];
+  });
+  const int64_t nToDelete = int64_t(_learnts.size()) / 2;
+  int64_t nKept = 0;
+  for (int64_t i = 0; i < int64_t(_learnts.size()); i++) {
+    const int64_t cref = _learnts[i];
+    if (i < nToDelete && _arena[cref + _cHdrLbd] > _cGlueLbd && !locked(cref)) {
+      _arena[cref + _cHdrMoved] = -2;
+      continue;
+    }
+    _learnts[nKept++] = cref;
+  }
+  _learnts.resize(nKept);
+  collectGarbage();
+}
+
+void Cdcl::collectGarbage() {
+  //// Copy the live clauses to a new arena, leaving their new positions in the old one
+  std::vector<int64_t> arena;
+  arena.reserve(_arena.size());
+  for (std::vector<int64_t> *pList : { &_originals, &_learnts }) {
+    for (int64_t &cref : *pList) {
+      const int64_t newCref = int64_t(arena.size());
+      arena.insert(arena.end(), _arena.begin() + cref, _arena.begin() + cref + _cnHdr + _arena[cref + _cHdrSize]);
+      _arena[cref + _cHdrMoved] = newCref;
+      cref = newCref;
+    }
+  }
+  for (int64_t i = 0; i < int64_t(_trail.size()); i++) {
+    const int64_t var = varOf(_trail[i]);
+    if (_reason[var] >= 0) {
+      _reason[var] = _arena[_reason[var] + _cHdrMoved];
+    }
+  }
+  _arena.swap(arena);
+
+  //// The watches only depend on the first two literals of each clause, so rebuild them
+  for (int64_t i = 0; i < int64_t(_watches.size()); i++) {
+    _watches[i].clear();
+  }
+  for (const std::vector<int64_t> *pList : { &_originals, &_learnts }) {
+    for (const int64_t cref : *pList) {
+      _arena[cref + _cHdrMoved] = -1;
+      const int64_t *pLits = litsOf(cref);
+      _watches[pLits[0]].push_back(Watch{ cref, pLits[1] });
+      _watches[pLits[1]].push_back(Watch{ cref, pLits[0] });
+    }
+  }
+}
+
+// The Luby sequence 1, 1, 2, 1, 1, 2, 4, ... scaled as powers of |y|.
+double Cdcl::luby(const double y, int64_t x) {
+  int64_t size = 1;
+  int64_t seq = 0;
+  while (size < x + 1) {
+    seq++;
+    size = 2 * size + 1;
+  }
+  while (size - 1 != x) {
+    size = (size - 1) >> 1;
+    seq--;
+    x = x % size;
+  }
+  return pow(y, double(seq));
+}
+
+SolveResult Cdcl::Solve(const std::atomic<bool> *pStop) {
+  if (_bUnsat || propagate() >= 0) {
+    return SolveResult::Unsat;
+  }
+  WorkerStats &ws = Stats::Local();
+  int64_t nRestarts = 0;
+  int64_t nConflictsLeft = int64_t(_cRestartUnit * luby(2, nRestarts));
+  for (;;) {
+    if (pStop != nullptr && pStop->load(std::memory_order_relaxed)) {
+      return SolveResult::Unknown;
+    }
+    const int64_t confl = propagate();
+    if (confl >= 0) {
+      ws.Add(WorkerStats::cConflicts, 1);
+      if (decisionLevel() == 0) {
+        return SolveResult::Unsat;
+      }
+      int64_t btLevel, lbd;
+      analyze(confl, btLevel, lbd);
+      backtrack(btLevel);
+      if (_learnt.size() == 1) {
+        enqueue(_learnt[0], -1);
+      }
+      else {
+        const int64_t cref = allocClause(_learnt.data(), int64_t(_learnt.size()), lbd);
+        _learnts.push_back(cref);
+        enqueue(_learnt[0], cref);
+      }
+      _varInc *= 1 / 0.95;
+      nConflictsLeft--;
+      continue;
+    }
+
+    if (nConflictsLeft <= 0) {
+      nRestarts++;
+      nConflictsLeft = int64_t(_cRestartUnit * luby(2, nRestarts));
+      backtrack(0);
+    }
+    if (int64_t(_learnts.size()) - int64_t(_trail.size()) >= _maxLearnts) {
+      reduceLearnts();
+      _maxLearnts += _maxLearnts / 10;
+    }
+
+    //// Decide
+    int64_t var = -1;
+    while (!_heap.empty()) {
+      const int64_t cand = heapPopMax();
+      if (_value[2 * cand] == 0) {
+        var = cand;
+        break;
+      }
+    }
+    if (var == -1) {
+      return SolveResult::Sat; // all the variables are assigned without a conflict
+    }
+    ws.Add(WorkerStats::cNodes, 1);
+    _trailLim.push_back(int64_t(_trail.size()));
+    enqueue(_phase[var] ? 2 * var : 2 * var + 1, -1);
+  }
+}
+
+template void Cdcl::Load<int32_t>(const Problem<int32_t> &prob);
+template void Cdcl::Load<int64_t>(const Problem<int64_t> &prob);
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Problem.h"
+
+// A conflict-driven clause-learning engine: two watched literals, first-UIP learning with the minimization of the
+//   learned clauses, VSIDS activities with phase saving, Luby restarts and the periodic deletion of the learned
+//   clauses of high LBD. It runs in the calling thread on the residual problem left by the normalization.
+class Cdcl {
+  // The literal of variable v is 2*v if positive, and 2*v+1 if negative.
+  static int64_t litOf(const int64_t signedVar) { return 2 * abs(signedVar) + (signedVar < 0 ? 1 : 0); }
+  static int64_t varOf(const int64_t lit) { return lit >> 1; }
+  static int64_t negOf(const int64_t lit) { return lit ^ 1; }
+
+  // A clause in the arena is the header followed by the literals, of which the first two are watched. The
+  //   propagated literal of a reason clause is the first one.
+  static const int64_t _cHdrSize = 0;
+  // The LBD of a learned clause, 0 for the original clauses.
+  static const int64_t _cHdrLbd = 1;
+  // The new position of a clause during the garbage collection, -1 for a live clause, -2 for a deleted one.
+  static const int64_t _cHdrMoved = 2;
+  static const int64_t _cnHdr = 3;
+  // The clauses of at most this LBD are never deleted.
+  static const int64_t _cGlueLbd = 2;
+  static const int64_t _cRestartUnit = 100;
+
+  struct Watch {
+    int64_t _cref;
+    // Another literal of the clause: if it's true, the clause needn't be visited.
+    int64_t _blocker;
+  };
+
+  int64_t _nVars = 0;
+  bool _bUnsat = false;
+  std::vector<int64_t> _arena;
+  std::vector<int64_t> _originals;
+  std::vector<int64_t> _learnts;
+  // The clauses watching each literal, visited when the literal becomes false.
+  std::vector<std::vector<Watch>> _watches;
+
+  // For each literal: 1 if true, -1 if false, 0 if unassigned.
+  std::vector<int8_t> _value;
+  std::vector<int64_t> _level;
+  // The clause which implied the variable, or -1 for the decisions and the variables of level 0.
+  std::vector<int64_t> _reason;
+  std::vector<int64_t> _trail;
+  // The start of each decision level in the trail.
+  std::vector<int64_t> _trailLim;
+  int64_t _qHead = 0;
+
+  //// VSIDS with a binary max-heap of the unassigned variables
+  std::vector<double> _activity;
+  double _varInc = 1;
+  std::vector<int64_t> _heap;
+  // The position of a variable in the heap, or -1 if it's not there.
+  std::vector<int64_t> _heapPos;
+  // The last value of each variable, used as the polarity of its next decision.
+  std::vector<bool> _phase;
+
+  //// The buffers of the conflict analysis
+  std::vector<int8_t> _seen;
+  std::vector<int64_t> _learnt;
+  std::vector<int64_t> _toClear;
+  std::vector<int64_t> _levelStamp;
+  int64_t _lbdEpoch = 0;
+
+  int64_t _maxLearnts = 0;
+
+  int64_t decisionLevel() const { return int64_t(_trailLim.size()); }
+  int64_t *litsOf(const int64_t cref) { return &_arena[cref + _cnHdr]; }
+  bool locked(const int64_t cref);
+
+  void heapUp(int64_t at);
+  void heapDown(int64_t at);
+  void heapInsert(const int64_t var);
+  int64_t heapPopMax();
+  void bumpVar(const int64_t var);
+
+  void enqueue(const int64_t lit, const int64_t reason);
+  // Returns the conflicting clause, or -1 if there is no conflict.
+  int64_t propagate();
+  // Fills |_learnt| with the asserting literal first and a literal of the backjump level second.
+  void analyze(int64_t confl, int64_t &btLevel, int64_t &lbd);
+  bool redundant(const int64_t lit);
+  void backtrack(const int64_t level);
+  int64_t allocClause(const int64_t *pLits, const int64_t nLits, const int64_t lbd);
+  // Adds a clause at level 0, simplifying it by the assignment.
+  void addClause(std::vector<int64_t> &lits);
+  void reduceLearnts();
+  void collectGarbage();
+  static double luby(const double y, int64_t x);
+
+public:
+  // Loads the clauses of the problem over its unknown variables. The polarities start from the model of the
+  //   2-clauses.
+  template<typename TIdx> void Load(const Problem<TIdx> &prob);
+
+  // Returns Sat if the problem is satisfiable, and then Value() gives a model. Returns Unknown once |*pStop| is set.
+  SolveResult Solve(const std::atomic<bool> *pStop = nullptr);
+
+  // The value of the variable in the model found by Solve(): |false| for the variables not in the clauses.
+  bool Value(const int64_t absVar) const { return _value[litOf(absVar)] == 1; }
+};
@@ -0,0 +1,257 @@
+#include "stdafx.h"
+#include "Coordinator.h"
+
+namespace {
+
+// Quotes an argument of the command line if it has spaces or quotes.
+std::string QuoteArg(const std::string &arg) {
+  if (!arg.empty() && arg.find_first_of(" \t\"") == std::string::npos) {
+    return arg;
+  }
+  std::string ans = "\"";
+  for (const char c : arg) {
+    if (c == '"') {
+      ans += '\\';
+    }
+    ans += c;
+  }
+  return ans + '"';
+}
+
+} // anonymous namespace
+
+Coordinator::Coordinator(const std::vector<std::string> &args, const int64_t nProcesses) : _workers(nProcesses) {
+  char exePath[MAX_PATH];
+  GetModuleFileNameA(nullptr, exePath, MAX_PATH);
+  _commandLine = QuoteArg(exePath);
+  for (const std::string &arg : args) {
+    _commandLine += " " + QuoteArg(arg);
+  }
+  _commandLine += " --cube-worker on";
+}
+
+Coordinator::~Coordinator() {
+  for (int64_t i = 0; i < int64_t(_workers.size()); i++) {
+    stop(i, _workers[i]._iCube >= 0);
+  }
+}
+
+bool Coordinator::spawn(const int64_t iWorker) {
+  Worker &w = _workers[iWorker];
+  SECURITY_ATTRIBUTES sa = {};
+  sa.nLength = sizeof(sa);
+  sa.bInheritHandle = TRUE;
+  HANDLE hChildInput = nullptr, hChildOutput = nullptr;
+  if (!CreatePipe(&hChildInput, &w._hInput, &sa, 0)) {
+    fprintf(stderr, "Cannot create a pipe to a worker process: error %lu.\n", GetLastError());
+    return false;
+  }
+  if (!CreatePipe(&w._hOutput, &hChildOutput, &sa, 0)) {
+    fprintf(stderr, "Cannot create a pipe from a worker process: error %lu.\n", GetLastError());
+    CloseHandle(hChildInput);
+    CloseHandle(w._hInput);
+    return false;
+  }
+  // Only the ends of the worker are inherited, so that it sees the end of its input when the coordinator closes it.
+  SetHandleInformation(w._hInput, HANDLE_FLAG_INHERIT, 0);
+  SetHandleInformation(w._hOutput, HANDLE_FLAG_INHERIT, 0);
+
+  STARTUPINFOA si = {};
+  si.cb = sizeof(si);
+  si.dwFlags = STARTF_USESTDHANDLES;
+  si.hStdInput = hChildInput;
+  si.hStdOutput = hChildOutput;
+  si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+  PROCESS_INFORMATION pi = {};
+  std::vector<char> commandLine(_commandLine.begin(), _commandLine.end());
+  commandLine.push_back(0);
+  const BOOL bCreated = CreateProcessA(nullptr, commandLine.data(), nullptr, nullptr, TRUE, 0, nullptr, nullptr,
+    &si, &pi);
+  CloseHandle(hChildInput);
+  CloseHandle(hChildOutput);
+  if (!bCreated) {
+    fprintf(stderr, "Cannot start a worker process: error %lu.\n", GetLastError());
+    CloseHandle(w._hInput);
+    CloseHandle(w._hOutput);
+    return false;
+  }
+  CloseHandle(pi.hThread);
+  w._hProcess = pi.hProcess;
+  w._spawn++;
+  w._bRunning = true;
+  w._iCube = -1;
+  w._reader = std::thread(&Coordinator::reader, this, iWorker, w._spawn);
+  return true;
+}
+
+void Coordinator::stop(const int64_t iWorker, const bool bKill) {
+  Worker &w = _workers[iWorker];
+  if (!w._bRunning) {
+    return;
+  }
+  CloseHandle(w._hInput);
+  if (bKill) {
+    TerminateProcess(w._hProcess, 1);
+  }
+  WaitForSingleObject(w._hProcess, INFINITE);
+  // The reader gets the end of the output once the process has exited.
+  w._reader.join();
+  CloseHandle(w._hOutput);
+  CloseHandle(w._hProcess);
+  w._bRunning = false;
+  w._iCube = -1;
+}
+
+void Coordinator::post(Event &&ev) {
+  std::unique_lock<std::mutex> lock(_mEvents);
+  _events.push(std::move(ev));
+  _cvEvents.notify_one();
+}
+
+void Coordinator::reader(const int64_t iWorker, const int64_t spawn) {
+  const HANDLE hOutput = _workers[iWorker]._hOutput;
+  std::string line;
+  Event ev;
+  ev._iWorker = iWorker;
+  ev._spawn = spawn;
+  char buffer[1 << 16];
+  DWORD nRead = 0;
+  while (ReadFile(hOutput, buffer, sizeof(buffer), &nRead, nullptr) && nRead > 0) {
+    for (DWORD i = 0; i < nRead; i++) {
+      if (buffer[i] != '\n') {
+        if (buffer[i] != '\r') {
+          line += buffer[i];
+        }
+        continue;
+      }
+      if (line == "s SAT") {
+        ev._model.clear();
+      }
+      else if (line == "s UNSAT" || line == "s UNKNOWN") {
+        ev._result = (line == "s UNSAT") ? SolveResult::Unsat : SolveResult::Unknown;
+        post(Event(ev));
+      }
+      else if (line.size() >= 2 && line[0] == 'v' && line[1] == ' ') {
+        const char *p = line.c_str() + 1;
+        char *pEnd = nullptr;
+        for (;;) {
+          const int64_t lit = strtoll(p, &pEnd, 10);
+          if (pEnd == p) {
+            break;
+          }
+          if (lit == 0) {
+            ev._result = SolveResult::Sat;
+            post(Event(ev));
+            break;
+          }
+          ev._model.push_back(lit);
+          p = pEnd;
+        }
+      }
+      line.clear();
+    }
+  }
+  ev._bExited = true;
+  ev._model.clear();
+  post(std::move(ev));
+}
+
+bool Coordinator::feed(const int64_t iWorker, const std::vector<int64_t> &cube) {
+  std::string line = "a";
+  for (const int64_t lit : cube) {
+    line += " " + std::to_string(lit);
+  }
+  line += " 0\n";
+  DWORD nWritten = 0;
+  for (size_t at = 0; at < line.size(); at += nWritten) {
+    if (!WriteFile(_workers[iWorker]._hInput, line.data() + at, DWORD(line.size() - at), &nWritten, nullptr)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+SolveResult Coordinator::Solve(const std::vector<std::vector<int64_t>> &cubes, std::vector<int64_t> &model) {
+  std::deque<int64_t> pending;
+  for (int64_t i = 0; i < int64_t(cubes.size()); i++) {
+    pending.push_back(i);
+  }
+  std::vector<int8_t> failures(cubes.size(), 0);
+  bool bUnknown = false;
+  bool bSat = false;
+  int64_t nInFlight = 0;
+  // Gives the next cube to the worker if it's idle. A failed write shows up as the exit of the worker.
+  auto dispatch = [&](const int64_t iWorker) {
+    Worker &w = _workers[iWorker];
+    if (!w._bRunning || w._iCube >= 0 || pending.empty()) {
+      return;
+    }
+    w._iCube = pending.front();
+    pending.pop_front();
+    nInFlight++;
+    feed(iWorker, cubes[w._iCube]);
+  };
+  for (int64_t i = 0; i < int64_t(_workers.size()) && i < int64_t(cubes.size()); i++) {
+    if (spawn(i)) {
+      dispatch(i);
+    }
+  }
+
+  while (!bSat && (nInFlight > 0 || !pending.empty())) {
+    if (nInFlight == 0) {
+      // No worker could be started.
+      bUnknown = true;
+      break;
+    }
+    Event ev;
+    {
+      std::unique_lock<std::mutex> lock(_mEvents);
+      _cvEvents.wait(lock, [&] { return !_events.empty(); });
+      ev = std::move(_events.front());
+      _events.pop();
+    }
+    Worker &w = _workers[ev._iWorker];
+    if (!w._bRunning || ev._spawn != w._spawn) {
+      continue; // an event of a process already stopped
+    }
+    if (ev._bExited) {
+      const int64_t iCube = w._iCube;
+      stop(ev._iWorker, true);
+      if (iCube >= 0) {
+        nInFlight--;
+        if (failures[iCube]++ == 0) {
+          fprintf(stderr, "A worker process has exited while solving cube %lld, retrying it.\n", iCube);
+          pending.push_front(iCube);
+        }
+        else {
+          fprintf(stderr, "Cube %lld has failed twice, so its answer is unknown.\n", iCube);
+          bUnknown = true;
+        }
+      }
+      if (!pending.empty() && spawn(ev._iWorker)) {
+        dispatch(ev._iWorker);
+      }
+      continue;
+    }
+    if (w._iCube < 0) {
+      continue; // an answer without a cube, e.g. to a line the worker has ignored
+    }
+    w._iCube = -1;
+    nInFlight--;
+    if (ev._result == SolveResult::Sat) {
+      model = std::move(ev._model);
+      bSat = true;
+      break;
+    }
+    if (ev._result == SolveResult::Unknown) {
+      bUnknown = true;
+    }
+    dispatch(ev._iWorker);
+  }
+
+  // The idle workers exit at the end of their input, and those solving other cubes are not needed any more.
+  for (int64_t i = 0; i < int64_t(_workers.size()); i++) {
+    stop(i, _workers[i]._iCube >= 0);
+  }
+  return bSat ? SolveResult::Sat : (bUnknown ? SolveResult::Unknown : SolveResult::Unsat);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Problem.h"
+
+// Solves the cubes in worker processes, each a copy of this executable run with the given options, which reads the
+//   cubes from its standard input as "a <literals> 0" lines and answers each with "s SAT" followed by
+//   "v <literals> 0", with "s UNSAT" or with "s UNKNOWN". The cubes are fed one at a time to the idle workers, so
+//   that the workers getting easy cubes take more of them. A worker that dies takes only its current cube with it:
+//   the cube is retried once in a new worker, and the answer is Unknown if it fails again.
+class Coordinator {
+  // A line of answer from a worker, or its exit.
+  struct Event {
+    int64_t _iWorker;
+    int64_t _spawn;
+    bool _bExited = false;
+    SolveResult _result = SolveResult::Unknown;
+    std::vector<int64_t> _model;
+  };
+
+  struct Worker {
+    HANDLE _hProcess = nullptr;
+    // The ends of the pipes to the standard input and from the standard output of the worker.
+    HANDLE _hInput = nullptr;
+    HANDLE _hOutput = nullptr;
+    std::thread _reader;
+    // Incremented on each start, so that the events of a previous process in the slot are ignored.
+    int64_t _spawn = 0;
+    bool _bRunning = false;
+    // The cube being solved, or -1 if idle.
+    int64_t _iCube = -1;
+  };
+
+  std::string _commandLine;
+  std::vector<Worker> _workers;
+  std::mutex _mEvents;
+  std::condition_variable _cvEvents;
+  std::queue<Event> _events;
+
+  // Returns |false| if the process couldn't be started.
+  bool spawn(const int64_t iWorker);
+  // Closes the input of the worker, so that it exits after the current cube, or kills it if |bKill|.
+  void stop(const int64_t iWorker, const bool bKill);
+  void reader(const int64_t iWorker, const int64_t spawn);
+  // Returns |false| if the worker has closed its input.
+  bool feed(const int64_t iWorker, const std::vector<int64_t> &cube);
+  void post(Event &&ev);
+
+public:
+  // |args| are the options of the workers, to which the options of the worker mode are added.
+  Coordinator(const std::vector<std::string> &args, const int64_t nProcesses);
+  ~Coordinator();
+  Coordinator(const Coordinator&) = delete;
+  Coordinator& operator=(const Coordinator&) = delete;
+
+  // Returns Sat with the literals of the model found for some cube, Unsat if all the cubes are unsatisfiable,
+  //   otherwise Unknown.
+  SolveResult Solve(const std::vector<std::vector<int64_t>> &cubes, std::vector<int64_t> &model);
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "FastVector.h"
+#include "UndoTrail.h"
+
+// A chunked variant of FastVector where copies share the chunks: a copy costs only the chunk table, and a chunk is
+//   copied on the first modification while it is shared with another vector.
+// The chunks are reference-counted atomically, because problems travel between worker threads.
+template<typename T> class CowVector {
+public:
+  static const int64_t _cChunkBytes = 2 * MemPool::_cPageSize;
+  // A multiple of 64 items, so that a pack of a shadow bitmap never crosses a chunk boundary.
+  static const int64_t _cChunkItems = ((_cChunkBytes - MemPool::_cAlignment) / int64_t(sizeof(T))) & ~int64_t(63);
+  static_assert(_cChunkItems >= 64, "The items are too large for a chunk.");
+
+private:
+  struct Chunk {
+    std::atomic<int64_t> _nRefs;
+    // The items must be aligned for Helper::AlignedCopy
+    alignas(MemPool::_cAlignment) T _items[_cChunkItems];
+  };
+
+  FastVector<Chunk*> _chunks;
+  int64_t _size;
+
+  static int64_t ChunkOf(const int64_t at) { return uint64_t(at) / _cChunkItems; }
+  static int64_t OffsetOf(const int64_t at) { return uint64_t(at) % _cChunkItems; }
+
+  static Chunk* NewChunk() {
+    Chunk *pChunk = reinterpret_cast<Chunk*>(MemPool::Instance().Acquire(sizeof(Chunk)));
+    new(&pChunk->_nRefs) std::atomic<int64_t>(1);
+    return pChunk;
+  }
+
+  static void Unref(Chunk *pChunk) {
+    if (pChunk->_nRefs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      MemPool::Instance().Release(pChunk, sizeof(Chunk));
+    }
+  }
+
+  void UnrefAll() {
+    for (int64_t i = 0; i < _chunks.size(); i++) {
+      Unref(_chunks[i]);
+    }
+  }
+
+  void ShareAll() {
+    for (int64_t i = 0; i < _chunks.size(); i++) {
+      _chunks[i]->_nRefs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns a chunk owned only by this vector, copying it if it's shared.
+  Chunk* OwnChunk(const int64_t iChunk) {
+    Chunk *pChunk = _chunks[iChunk];
+    if (pChunk->_nRefs.load(std::memory_order_acquire) == 1) {
+      return pChunk;
+    }
+    Chunk *pOwn = NewChunk();
+    Helper::AlignedCopy(pOwn->_items, pChunk->_items, sizeof(pChunk->_items));
+    Unref(pChunk);
+    _chunks.UnshadowedModify(iChunk) = pOwn;
+    return pOwn;
+  }
+
+public:
+  CowVector() {
+    _size = 0;
+  }
+
+  CowVector(const CowVector& fellow) : _chunks(fellow._chunks) {
+    _size = fellow._size;
+    ShareAll();
+  }
+  CowVector& operator=(const CowVector& fellow) {
+    if (this != &fellow) {
+      UnrefAll();
+      _chunks = fellow._chunks;
+      _size = fellow._size;
+      ShareAll();
+    }
+    return *this;
+  }
+
+  CowVector(CowVector&& fellow) : _chunks(std::move(fellow._chunks)) {
+    _size = fellow._size;
+    fellow._size = 0;
+  }
+  CowVector& operator=(CowVector&& fellow) {
+    if (this != &fellow) {
+      UnrefAll();
+      _chunks = std::move(fellow._chunks);
+      _size = fellow._size;
+      fellow._size = 0;
+    }
+    return *this;
+  }
+
+  ~CowVector() {
+    UnrefAll();
+  }
+
+
+  int64_t size() const { return _size; }
+
+  void emplace_back() {
+    if (_size >= _chunks.size() * _cChunkItems) {
+      _chunks.emplace_back();
+      _chunks.UnshadowedModifyBack() = NewChunk();
+    }
+    _size++;
+  }
+
+  void pop_back() {
+    if (_size <= 0) {
+      __debugbreak();
+    }
+    _size--;
+  }
+
+  const T& operator[](const int64_t at) const {
+    if (at < 0 || at >= _size) {
+      fprintf(stderr, "Out of range %lld while size %lld.\n", at, _size);
+      __debugbreak();
+    }
+    return _chunks[ChunkOf(at)]->_items[OffsetOf(at)];
+  }
+
+  const T& back() const {
+    return (*this)[_size - 1];
+  }
+
+  void AssignZeros(const int64_t nItems, const bool init = true) {
+    UnrefAll();
+    const int64_t nChunks = (nItems + _cChunkItems - 1) / _cChunkItems;
+    _chunks.AssignZeros(nChunks, false);
+    for (int64_t i = 0; i < nChunks; i++) {
+      Chunk *pChunk = NewChunk();
+      if (init) {
+        memset(pChunk->_items, 0, sizeof(pChunk->_items));
+      }
+      _chunks.UnshadowedModify(i) = pChunk;
+    }
+    _size = nItems;
+  }
+  // Capacity must allow such a size already.
+  void SetSize(const int64_t nItems) {
+    if (nItems < 0 || nItems > _chunks.size() * _cChunkItems) {
+      __debugbreak();
+    }
+    _size = nItems;
+  }
+
+  T& Modify(const int64_t at, FastVector<uint64_t> *pShadow, UndoTrail *pTrail) {
+    if (pShadow != nullptr) {
+      const int64_t iPack = at >> 6;
+      if (iPack < pShadow->size()) {
+        pShadow->UnshadowedModify(iPack) |= (1ull << (at & 63));
+      }
+    }
+    T& item = UnshadowedModify(at);
+    if (pTrail != nullptr) {
+      pTrail->Log(*this, at, item);
+    }
+    return item;
+  }
+  T& ModifyBack(FastVector<uint64_t> *pShadow, UndoTrail *pTrail) {
+    return Modify(_size - 1, pShadow, pTrail);
+  }
+
+  T& UnshadowedModify(const int64_t at) {
+    if (at < 0 || at >= _size) {
+      fprintf(stderr, "Out of range %lld while size %lld.\n", at, _size);
+      __debugbreak();
+    }
+    return OwnChunk(ChunkOf(at))->_items[OffsetOf(at)];
+  }
+  T& UnshadowedModifyBack() {
+    return UnshadowedModify(_size - 1);
+  }
+};
+
+// A bit vector with copy-on-write chunks, for the variable assignments.
+class CowBits {
+  CowVector<uint64_t> _packs;
+  int64_t _nBits = 0;
+
+public:
+  int64_t size() const { return _nBits; }
+
+  void Resize(const int64_t nBits) {
+    _packs.AssignZeros((nBits + 63) >> 6);
+    _nBits = nBits;
+  }
+
+  bool operator[](const int64_t at) const {
+    return (_packs[at >> 6] >> (at & 63)) & 1;
+  }
+
+  void Set(const int64_t at, const bool value, UndoTrail *pTrail) {
+    uint64_t &pack = _packs.Modify(at >> 6, nullptr, pTrail);
+    if (value) {
+      pack |= (1ull << (at & 63));
+    }
+    else {
+      pack &= ~(1ull << (at & 63));
+    }
+  }
+};
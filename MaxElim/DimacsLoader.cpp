@@ -0,0 +1,357 @@
+#include "stdafx.h"
+#include "DimacsLoader.h"
+
+namespace {
+  bool IsSpace(const char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  // Runs |f(i)| for i in [0, n), each in its own thread except the first one.
+  template<typename F> void RunParallel(const int64_t n, const F &f) {
+    std::vector<std::thread> threads;
+    for (int64_t i = 1; i < n; i++) {
+      threads.emplace_back(f, i);
+    }
+    f(0);
+    for (size_t i = 0; i < threads.size(); i++) {
+      threads[i].join();
+    }
+  }
+}
+
+void DimacsLoader::markUsed(const int64_t *lits, const int64_t nLits) {
+  for (int64_t j = 0; j < nLits; j++) {
+    const int64_t absVar = abs(lits[j]);
+    std::atomic<uint64_t> &pack = _usedVars[absVar >> 6];
+    const uint64_t mask = 1ull << (absVar & 63);
+    if ((pack.load(std::memory_order_relaxed) & mask) == 0) {
+      pack.fetch_or(mask, std::memory_order_relaxed);
+    }
+  }
+}
+
+int64_t DimacsLoader::finishClause(int64_t *lits, const int64_t nLits) {
+  std::sort(lits, lits + nLits);
+  int64_t n = 0;
+  for (int64_t i = 0; i < nLits; i++) {
+    if (n > 0 && lits[n - 1] == lits[i]) {
+      continue;
+    }
+    lits[n++] = lits[i];
+  }
+  // The negative literals precede the positive ones, so a complementary pair is found by a merge of the two.
+  int64_t iPos = 0;
+  while (iPos < n && lits[iPos] < 0) {
+    iPos++;
+  }
+  for (int64_t iNeg = iPos - 1, k = iPos; iNeg >= 0 && k < n; ) {
+    if (-lits[iNeg] == lits[k]) {
+      return -1;
+    }
+    if (-lits[iNeg] < lits[k]) {
+      iNeg--;
+    }
+    else {
+      k++;
+    }
+  }
+  return n;
+}
+
+template<typename TIdx>
+void DimacsLoader::emitClause(const int64_t *lits, const int64_t nLits, Chunk<TIdx> &chunk) {
+  if (nLits == 0) {
+    chunk._bEmpty = true;
+    return;
+  }
+  markUsed(lits, nLits);
+  if (nLits > 3) {
+    for (int64_t j = 0; j < nLits; j++) {
+      chunk._longLits.push_back(TIdx(lits[j]));
+    }
+    chunk._longSizes.push_back(TIdx(nLits));
+    return;
+  }
+  chunk._clauses.emplace_back();
+  Clause3<TIdx> &cl = chunk._clauses.UnshadowedModifyBack();
+  for (int8_t j = 0; j < 3; j++) {
+    cl._vars[j] = TIdx(j < nLits ? lits[j] : 0);
+  }
+}
+
+// Moves |p| to the beginning of the next line.
+void DimacsLoader::skipLine(const char *&p, const char *pEnd) {
+  while (p < pEnd && *p != '\n') {
+    p++;
+  }
+  if (p < pEnd) {
+    p++;
+  }
+}
+
+// Skips the spaces within the line, then parses a decimal integer.
+// Returns |false| if there is no integer before the end of the line.
+bool DimacsLoader::scanInt(const char *&p, const char *pEnd, int64_t &value) {
+  while (p < pEnd && IsSpace(*p)) {
+    p++;
+  }
+  const char *q = p;
+  bool bNegative = false;
+  if (q < pEnd && (*q == '-' || *q == '+')) {
+    bNegative = (*q == '-');
+    q++;
+  }
+  if (q >= pEnd || *q < '0' || *q > '9') {
+    return false;
+  }
+  int64_t magnitude = 0;
+  while (q < pEnd && *q >= '0' && *q <= '9') {
+    magnitude = magnitude * 10 + (*q - '0');
+    q++;
+  }
+  value = bNegative ? -magnitude : magnitude;
+  p = q;
+  return true;
+}
+
+// Parses the comments and the problem definition, leaving |p| at the line after the latter.
+int DimacsLoader::parseHeader(const char *&p, const char *pEnd) {
+  while (p < pEnd) {
+    while (p < pEnd && IsSpace(*p)) {
+      p++;
+    }
+    if (p >= pEnd || *p == '\n') { // empty line
+      skipLine(p, pEnd);
+      continue;
+    }
+    const bool bSingle = (p + 1 >= pEnd || IsSpace(p[1]) || p[1] == '\n');
+    if (bSingle && (*p == 'c' || *p == 'C')) { // a comment line
+      skipLine(p, pEnd);
+      continue;
+    }
+    if (!bSingle || (*p != 'p' && *p != 'P')) {
+      fprintf(stderr, "A clause seems to appear before a problem definition.\n");
+      return 3;
+    }
+    p++;
+    while (p < pEnd && IsSpace(*p)) {
+      p++;
+    }
+    const char *pFormat = p;
+    while (p < pEnd && !IsSpace(*p) && *p != '\n') {
+      p++;
+    }
+    if (p == pFormat || !scanInt(p, pEnd, _nVars) || !scanInt(p, pEnd, _nClauses)) {
+      fprintf(stderr, "Error in problem definition.\n");
+      return 2;
+    }
+    skipLine(p, pEnd);
+    return 0;
+  }
+  fprintf(stderr, "No problem definition.\n");
+  return 5;
+}
+
+template<typename TIdx> void DimacsLoader::parseChunk(Chunk<TIdx> &chunk) {
+  const char *p = chunk._pBegin;
+  const char *pEnd = chunk._pEnd;
+  std::vector<int64_t> lits;
+  while (p < pEnd) {
+    while (p < pEnd && IsSpace(*p)) {
+      p++;
+    }
+    if (p < pEnd && *p != '\n' && *p != '-' && *p != '+' && (*p < '0' || *p > '9')) {
+      const bool bSingle = (p + 1 >= pEnd || IsSpace(p[1]) || p[1] == '\n');
+      if (bSingle && (*p == 'p' || *p == 'P')) {
+        chunk._error = 1;
+        return;
+      }
+      skipLine(p, pEnd); // a comment or an unknown line
+      continue;
+    }
+    int64_t var;
+    while (scanInt(p, pEnd, var)) {
+      if (var == 0) {
+        if (!chunk._bClosed) {
+          chunk._head = lits;
+          chunk._bClosed = true;
+        }
+        else {
+          chunk._nRead++;
+          const int64_t n = finishClause(lits.data(), int64_t(lits.size()));
+          if (n >= 0) {
+            emitClause(lits.data(), n, chunk);
+          }
+        }
+        lits.clear();
+        continue;
+      }
+      if (abs(var) > _nVars) {
+        chunk._error = 9;
+        chunk._errorValue = var;
+        return;
+      }
+      lits.push_back(var);
+    }
+    skipLine(p, pEnd);
+  }
+  if (chunk._bClosed) {
+    chunk._tail = lits;
+  }
+  else {
+    chunk._head = lits;
+  }
+}
+
+int DimacsLoader::reportError(const int error, const int64_t value) {
+  switch (error) {
+  case 1:
+    fprintf(stderr, "Duplicate problem definition.\n");
+    break;
+  case 9:
+    fprintf(stderr, "Variable out of range: %lld\n", value);
+    break;
+  }
+  return error;
+}
+
+DimacsLoader::~DimacsLoader() {
+  if (_pText != nullptr) {
+    UnmapViewOfFile(_pText);
+    CloseHandle(_hMapping);
+  }
+  if (_hFile != INVALID_HANDLE_VALUE) {
+    CloseHandle(_hFile);
+  }
+}
+
+int DimacsLoader::Open(const char *fn) {
+  _hFile = CreateFileA(fn, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+    nullptr);
+  if (_hFile == INVALID_HANDLE_VALUE) {
+    fprintf(stderr, "Cannot open %s\n", fn);
+    return 6;
+  }
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(_hFile, &fileSize)) {
+    fprintf(stderr, "Cannot get the size of %s\n", fn);
+    return 6;
+  }
+  // An empty file can't be mapped.
+  if (fileSize.QuadPart > 0) {
+    _hMapping = CreateFileMappingA(_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_hMapping == nullptr) {
+      fprintf(stderr, "Cannot map %s into memory\n", fn);
+      return 6;
+    }
+    _pText = reinterpret_cast<const char*>(MapViewOfFile(_hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (_pText == nullptr) {
+      fprintf(stderr, "Cannot map %s into memory\n", fn);
+      CloseHandle(_hMapping);
+      return 6;
+    }
+  }
+  _pBody = _pText;
+  _pEnd = _pText + fileSize.QuadPart;
+  return parseHeader(_pBody, _pEnd);
+}
+
+template<typename TIdx> int DimacsLoader::LoadClauses(CowVector<Clause3<TIdx>> &clauses,
+  CowVector<ClauseK<TIdx>> &longClauses, CowVector<TIdx> &longLits, const int64_t nThreads)
+{
+  _usedVars.reset(new std::atomic<uint64_t>[(_nVars >> 6) + 1]());
+
+  //// Split at the line boundaries
+  const int64_t nBodyBytes = _pEnd - _pBody;
+  const int64_t nChunks = std::max<int64_t>(1, std::min(nThreads, nBodyBytes / _cMinChunkBytes));
+  std::vector<Chunk<TIdx>> chunks(nChunks);
+  for (int64_t i = 0; i < nChunks; i++) {
+    chunks[i]._pBegin = (i == 0) ? _pBody : chunks[i - 1]._pEnd;
+    const char *pLimit = _pBody + nBodyBytes * (i + 1) / nChunks;
+    if (pLimit > chunks[i]._pBegin && pLimit < _pEnd) {
+      // Extend up to the beginning of a line
+      while (pLimit[-1] != '\n' && pLimit < _pEnd) {
+        pLimit++;
+      }
+    }
+    chunks[i]._pEnd = std::max(chunks[i]._pBegin, pLimit);
+  }
+
+  RunParallel(nChunks, [&](const int64_t i) { parseChunk(chunks[i]); });
+
+  //// Join the clauses spanning the chunk boundaries, and place the chunks in the result
+  std::vector<int64_t> carry;
+  int64_t nTotal = 0;
+  // Including the tautologies, for the comparison with the problem definition.
+  int64_t nRead = 0;
+  // The clauses spanning the boundaries go to the chunk where they end.
+  std::vector<Chunk<TIdx>> leads(nChunks);
+  _bEmptyClause = false;
+  for (int64_t i = 0; i < nChunks; i++) {
+    Chunk<TIdx> &chunk = chunks[i];
+    if (chunk._error != 0) {
+      return reportError(chunk._error, chunk._errorValue);
+    }
+    _bEmptyClause |= chunk._bEmpty;
+    carry.insert(carry.end(), chunk._head.begin(), chunk._head.end());
+    if (!chunk._bClosed) {
+      continue;
+    }
+    nRead += 1 + chunk._nRead;
+    const int64_t n = finishClause(carry.data(), int64_t(carry.size()));
+    if (n >= 0) {
+      emitClause(carry.data(), n, leads[i]);
+    }
+    _bEmptyClause |= leads[i]._bEmpty;
+    nTotal += leads[i]._clauses.size();
+    chunk._iFirst = nTotal;
+    nTotal += chunk._clauses.size();
+    carry = chunk._tail;
+  }
+  // A clause without the terminating 0 at the end of the file is ignored.
+  if (nRead != _nClauses) {
+    fprintf(stderr, "Read %lld clauses instead of %lld\n", nRead, _nClauses);
+    return 5;
+  }
+
+  clauses.AssignZeros(nTotal, false);
+  // The chunks of |clauses| are owned by this vector only, so the threads can modify distinct items.
+  RunParallel(nChunks, [&](const int64_t i) {
+    const Chunk<TIdx> &chunk = chunks[i];
+    if (leads[i]._clauses.size() > 0) {
+      clauses.UnshadowedModify(chunk._iFirst - 1) = leads[i]._clauses[0];
+    }
+    for (int64_t k = 0; k < chunk._clauses.size(); k++) {
+      clauses.UnshadowedModify(chunk._iFirst + k) = chunk._clauses[k];
+    }
+  });
+
+  //// Concatenate the long clauses
+  longClauses.AssignZeros(0);
+  longLits.AssignZeros(0);
+  for (int64_t i = 0; i < 2 * nChunks; i++) {
+    const Chunk<TIdx> &chunk = (i & 1) ? chunks[i >> 1] : leads[i >> 1];
+    int64_t iLit = 0;
+    for (const TIdx size : chunk._longSizes) {
+      longClauses.emplace_back();
+      ClauseK<TIdx> &cl = longClauses.UnshadowedModifyBack();
+      cl._iFirst = TIdx(longLits.size());
+      cl._size = size;
+      for (int64_t j = 0; j < size; j++) {
+        longLits.emplace_back();
+        longLits.UnshadowedModifyBack() = chunk._longLits[iLit++];
+      }
+    }
+  }
+
+  _nUsedVars = 0;
+  for (int64_t i = 0; i <= (_nVars >> 6); i++) {
+    _nUsedVars += std::popcount(_usedVars[i].load(std::memory_order_relaxed));
+  }
+  return 0;
+}
+
+template int DimacsLoader::LoadClauses(CowVector<Clause3<int32_t>> &clauses,
+  CowVector<ClauseK<int32_t>> &longClauses, CowVector<int32_t> &longLits, const int64_t nThreads);
+template int DimacsLoader::LoadClauses(CowVector<Clause3<int64_t>> &clauses,
+  CowVector<ClauseK<int64_t>> &longClauses, CowVector<int64_t> &longLits, const int64_t nThreads);
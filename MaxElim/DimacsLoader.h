@@ -0,0 +1,75 @@
+#pragma once
+
+#include "RawClause.h"
+#include "CowVector.h"
+
+// Loads a DIMACS CNF. The file is mapped into memory, and the clauses are parsed in parallel chunks split at line
+//   boundaries. The clauses of up to 3 literals are padded to Clause3, and the longer ones go to a literal arena.
+class DimacsLoader {
+  // The minimum number of bytes for a chunk, so that small files are parsed by a single thread.
+  static const int64_t _cMinChunkBytes = 1 << 20;
+
+  template<typename TIdx> struct Chunk {
+    const char *_pBegin;
+    const char *_pEnd;
+    // The literals before the first 0, i.e. the end of a clause which started in a preceding chunk.
+    std::vector<int64_t> _head;
+    // Whether the chunk has a 0 at all: otherwise all its literals are in |_head|.
+    bool _bClosed = false;
+    // The clauses which start and end in this chunk, deduplicated and without the tautologies.
+    FastVector<Clause3<TIdx>> _clauses;
+    // Those of more than 3 literals: their literals one after another, and their sizes.
+    std::vector<TIdx> _longLits;
+    std::vector<TIdx> _longSizes;
+    // The number of such clauses including the tautologies.
+    int64_t _nRead = 0;
+    // Whether one of them has no literals.
+    bool _bEmpty = false;
+    // The literals after the last 0, i.e. the beginning of a clause which ends in a subsequent chunk.
+    std::vector<int64_t> _tail;
+    // The index of the first clause of |_clauses| in the result.
+    int64_t _iFirst = 0;
+    // The exit code for main(), and the value to report with it.
+    int _error = 0;
+    int64_t _errorValue = 0;
+  };
+
+  HANDLE _hFile = INVALID_HANDLE_VALUE;
+  HANDLE _hMapping = nullptr;
+  const char *_pText = nullptr;
+  // The text after the problem definition.
+  const char *_pBody = nullptr;
+  const char *_pEnd = nullptr;
+  std::unique_ptr<std::atomic<uint64_t>[]> _usedVars;
+
+  void markUsed(const int64_t *lits, const int64_t nLits);
+  // Sorts the literals ascending, dropping the duplicates.
+  // Returns the number of literals left, or -1 if the clause is a tautology.
+  static int64_t finishClause(int64_t *lits, const int64_t nLits);
+  // Adds the finished clause to the chunk, either as a Clause3 or as a long clause, or marks the chunk if the
+  //   clause is empty.
+  template<typename TIdx> void emitClause(const int64_t *lits, const int64_t nLits, Chunk<TIdx> &chunk);
+  static void skipLine(const char *&p, const char *pEnd);
+  static bool scanInt(const char *&p, const char *pEnd, int64_t &value);
+  int parseHeader(const char *&p, const char *pEnd);
+  template<typename TIdx> void parseChunk(Chunk<TIdx> &chunk);
+  static int reportError(const int error, const int64_t value);
+
+public:
+  int64_t _nVars = -1;
+  int64_t _nClauses = -1;
+  int64_t _nUsedVars = 0;
+  // Whether the loaded clauses include an empty one, so that the formula is unsatisfiable.
+  bool _bEmptyClause = false;
+
+  ~DimacsLoader();
+
+  // Maps the file and parses the problem definition, so that the index width can be chosen.
+  // Returns 0 on success, otherwise the exit code for main() after printing the error.
+  int Open(const char *fn);
+
+  // Stores the clauses of more than 3 literals as in Problem::_clk and Problem::_litsK.
+  // Returns 0 on success, otherwise the exit code for main() after printing the error.
+  template<typename TIdx> int LoadClauses(CowVector<Clause3<TIdx>> &clauses, CowVector<ClauseK<TIdx>> &longClauses,
+    CowVector<TIdx> &longLits, const int64_t nThreads);
+};
@@ -0,0 +1,97 @@
+#include "stdafx.h"
+#include "Kernels.h"
+
+// Constant-initialized, so that the copies before the detection, e.g. by the static constructors, work too.
+Kernels Kernels::_instance(Kernels::Isa::Scalar, &Kernels::CopyScalar, &Kernels::MaskedCopy4Scalar,
+  &Kernels::MaskedCopy8Scalar);
+
+namespace {
+
+const bool gbSelected = (Kernels::Select(Kernels::Isa::Avx512), true);
+
+// The bulk copy is cheaper than the item loop from this count of set bits of a pack.
+const int gcMaskedCopyDense = 16;
+
+template<typename TItem> void MaskedCopyScalar(void *pDst, const void *pSrc, uint64_t mask) {
+  if (std::popcount(mask) > gcMaskedCopyDense) {
+    Kernels::Copy(pDst, pSrc, 64 * sizeof(TItem));
+    return;
+  }
+  while (mask != 0) {
+    const int j = std::countr_zero(mask);
+    static_cast<TItem*>(pDst)[j] = static_cast<const TItem*>(pSrc)[j];
+    mask &= mask - 1;
+  }
+}
+
+} // anonymous namespace
+
+Kernels::Isa Kernels::detect() {
+  int regs[4];
+  __cpuidex(regs, 0, 0);
+  const int maxLeaf = regs[0];
+  __cpuidex(regs, 1, 0);
+  const bool bSse2 = (regs[3] & (1 << 26)) != 0;
+  // The OS must save the vector registers on the context switches.
+  const bool bOsXsave = (regs[2] & (1 << 27)) != 0;
+  const uint64_t xcr0 = bOsXsave ? _xgetbv(0) : 0;
+  const bool bOsAvx = (xcr0 & 0x6) == 0x6;
+  const bool bOsAvx512 = (xcr0 & 0xe6) == 0xe6;
+  int leaf7Ebx = 0;
+  if (maxLeaf >= 7) {
+    __cpuidex(regs, 7, 0);
+    leaf7Ebx = regs[1];
+  }
+  const bool bAvx2 = bOsAvx && (leaf7Ebx & (1 << 5)) != 0;
+  const bool bAvx512 = bAvx2 && bOsAvx512 && (leaf7Ebx & (1 << 16)) != 0 && (leaf7Ebx & (1 << 31)) != 0;
+  if (bAvx512) {
+    return Isa::Avx512;
+  }
+  if (bAvx2) {
+    return Isa::Avx2;
+  }
+  return bSse2 ? Isa::Sse2 : Isa::Scalar;
+}
+
+void Kernels::Select(const Isa isa) {
+  switch (std::min(isa, detect())) {
+  case Isa::Avx512:
+    // The 64-byte stores would split the cache lines of the 32-byte aligned buffers, so the copies stay AVX2.
+    _instance = Kernels(Isa::Avx512, &CopyAvx2, &MaskedCopy4Avx512, &MaskedCopy8Avx512);
+    break;
+  case Isa::Avx2:
+    _instance = Kernels(Isa::Avx2, &CopyAvx2, &MaskedCopy4Avx2, &MaskedCopy8Avx2);
+    break;
+  case Isa::Sse2:
+    // There's no masked store besides the non-temporal one, so the item loop stays scalar.
+    _instance = Kernels(Isa::Sse2, &CopySse2, &MaskedCopy4Scalar, &MaskedCopy8Scalar);
+    break;
+  default:
+    _instance = Kernels(Isa::Scalar, &CopyScalar, &MaskedCopy4Scalar, &MaskedCopy8Scalar);
+    break;
+  }
+}
+
+const char* Kernels::IsaName(const Isa isa) {
+  const char *const cNames[] = { "scalar", "sse2", "avx2", "avx512" };
+  return cNames[int(isa)];
+}
+
+void Kernels::CopyScalar(void *pDst, const void *pSrc, const int64_t nBytes) {
+  memcpy(pDst, pSrc, (nBytes + 31) & ~int64_t(31));
+}
+
+void Kernels::MaskedCopy4Scalar(void *pDst, const void *pSrc, const uint64_t mask) {
+  MaskedCopyScalar<uint32_t>(pDst, pSrc, mask);
+}
+
+void Kernels::MaskedCopy8Scalar(void *pDst, const void *pSrc, const uint64_t mask) {
+  MaskedCopyScalar<uint64_t>(pDst, pSrc, mask);
+}
+
+void Kernels::CopySse2(void *pDst, const void *pSrc, const int64_t nBytes) {
+  const int64_t nVects = ((nBytes + 31) >> 5) << 1;
+  for (int64_t i = 0; i < nVects; i++) {
+    _mm_store_si128(static_cast<__m128i*>(pDst) + i, _mm_load_si128(static_cast<const __m128i*>(pSrc) + i));
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+// The kernels of the hot copies, dispatched at runtime to the widest instruction set of the CPU, so that one binary
+//   runs on any x64 CPU. The AVX2 and AVX-512 kernels are compiled in their own translation units with those
+//   instruction sets enabled, while the rest of the program assumes only SSE2.
+class Kernels {
+public:
+  enum class Isa : int8_t {
+    Scalar,
+    Sse2,
+    Avx2,
+    // With the 256-bit forms (AVX-512VL), which keep the stores within the 32-byte alignment of the buffers.
+    Avx512
+  };
+
+  // Copies |nBytes| rounded up to a multiple of 32 between 32-byte aligned buffers.
+  typedef void (*TCopy)(void *pDst, const void *pSrc, const int64_t nBytes);
+  // Copies the items of a pack of 64 whose bits are set in |mask|. The other items of the pack may be copied too,
+  //   so both buffers must have room for the whole pack.
+  typedef void (*TMaskedCopy)(void *pDst, const void *pSrc, const uint64_t mask);
+
+private:
+  static Kernels _instance;
+
+  Isa _isa;
+  TCopy _copy;
+  // For the items of 4 and 8 bytes.
+  TMaskedCopy _maskedCopy4;
+  TMaskedCopy _maskedCopy8;
+
+  constexpr Kernels(const Isa isa, const TCopy copy, const TMaskedCopy maskedCopy4, const TMaskedCopy maskedCopy8)
+    : _isa(isa), _copy(copy), _maskedCopy4(maskedCopy4), _maskedCopy8(maskedCopy8)
+  { }
+
+  static Isa detect();
+
+public:
+  // Selects the kernels of |isa|, or of the widest instruction set the CPU supports if that's narrower.
+  static void Select(const Isa isa);
+  static Isa Current() { return _instance._isa; }
+  static const char* IsaName(const Isa isa);
+
+  // The copies keep the stores cached: every caller reads or modifies the destination right after the copy.
+  static void Copy(void *pDst, const void *pSrc, const int64_t nBytes) {
+    _instance._copy(pDst, pSrc, nBytes);
+  }
+
+  // Returns |true| if MaskedCopy() supports the items of |itemBytes|.
+  static constexpr bool CanMask(const int64_t itemBytes) {
+    return itemBytes == 4 || itemBytes == 8;
+  }
+  static void MaskedCopy(void *pDst, const void *pSrc, const uint64_t mask, const int64_t itemBytes) {
+    (itemBytes == 4 ? _instance._maskedCopy4 : _instance._maskedCopy8)(pDst, pSrc, mask);
+  }
+
+  //// The kernels of each instruction set
+  static void CopyScalar(void *pDst, const void *pSrc, const int64_t nBytes);
+  static void MaskedCopy4Scalar(void *pDst, const void *pSrc, const uint64_t mask);
+  static void MaskedCopy8Scalar(void *pDst, const void *pSrc, const uint64_t mask);
+  static void CopySse2(void *pDst, const void *pSrc, const int64_t nBytes);
+  static void CopyAvx2(void *pDst, const void *pSrc, const int64_t nBytes);
+  static void MaskedCopy4Avx2(void *pDst, const void *pSrc, const uint64_t mask);
+  static void MaskedCopy8Avx2(void *pDst, const void *pSrc, const uint64_t mask);
+  static void MaskedCopy4Avx512(void *pDst, const void *pSrc, const uint64_t mask);
+  static void MaskedCopy8Avx512(void *pDst, const void *pSrc, const uint64_t mask);
+};
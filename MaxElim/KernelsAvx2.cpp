@@ -0,0 +1,49 @@
+#include "stdafx.h"
+#include "Kernels.h"
+
+// Compiled with AVX2 enabled, and called only on the CPUs supporting it.
+
+void Kernels::CopyAvx2(void *pDst, const void *pSrc, const int64_t nBytes) {
+  const int64_t nVects = (nBytes + sizeof(__m256i) - 1) / sizeof(__m256i);
+  for (int64_t i = 0; i < nVects; i++) {
+    _mm256_store_si256(static_cast<__m256i*>(pDst) + i, _mm256_load_si256(static_cast<const __m256i*>(pSrc) + i));
+  }
+}
+
+// Each vector holds 8 items of the pack, whose bits are spread to the lanes of the store mask.
+void Kernels::MaskedCopy4Avx2(void *pDst, const void *pSrc, const uint64_t mask) {
+  const __m256i laneBits = _mm256_setr_epi32(1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7);
+  for (int64_t i = 0; i < 8; i++) {
+    const int bits = int(mask >> (i * 8)) & 0xff;
+    if (bits == 0) {
+      continue;
+    }
+    __m256i *const pTo = static_cast<__m256i*>(pDst) + i;
+    const __m256i loaded = _mm256_load_si256(static_cast<const __m256i*>(pSrc) + i);
+    if (bits == 0xff) {
+      _mm256_store_si256(pTo, loaded);
+      continue;
+    }
+    const __m256i lanes = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), laneBits), laneBits);
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(pTo), lanes, loaded);
+  }
+}
+
+// Each vector holds 4 items of the pack.
+void Kernels::MaskedCopy8Avx2(void *pDst, const void *pSrc, const uint64_t mask) {
+  const __m256i laneBits = _mm256_setr_epi64x(1 << 0, 1 << 1, 1 << 2, 1 << 3);
+  for (int64_t i = 0; i < 16; i++) {
+    const int bits = int(mask >> (i * 4)) & 0xf;
+    if (bits == 0) {
+      continue;
+    }
+    __m256i *const pTo = static_cast<__m256i*>(pDst) + i;
+    const __m256i loaded = _mm256_load_si256(static_cast<const __m256i*>(pSrc) + i);
+    if (bits == 0xf) {
+      _mm256_store_si256(pTo, loaded);
+      continue;
+    }
+    const __m256i lanes = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(bits), laneBits), laneBits);
+    _mm256_maskstore_epi64(reinterpret_cast<long long*>(pTo), lanes, loaded);
+  }
+}
@@ -0,0 +1,25 @@
+#include "stdafx.h"
+#include "Kernels.h"
+
+// Compiled with AVX-512 enabled, and called only on the CPUs supporting AVX-512F and AVX-512VL. The bits of the pack
+//   are the store masks as they are.
+
+void Kernels::MaskedCopy4Avx512(void *pDst, const void *pSrc, const uint64_t mask) {
+  for (int64_t i = 0; i < 8; i++) {
+    const __mmask8 bits = __mmask8(mask >> (i * 8));
+    if (bits != 0) {
+      _mm256_mask_store_epi32(static_cast<__m256i*>(pDst) + i, bits,
+        _mm256_load_si256(static_cast<const __m256i*>(pSrc) + i));
+    }
+  }
+}
+
+void Kernels::MaskedCopy8Avx512(void *pDst, const void *pSrc, const uint64_t mask) {
+  for (int64_t i = 0; i < 16; i++) {
+    const __mmask8 bits = __mmask8((mask >> (i * 4)) & 0xf);
+    if (bits != 0) {
+      _mm256_mask_store_epi64(static_cast<__m256i*>(pDst) + i, bits,
+        _mm256_load_si256(static_cast<const __m256i*>(pSrc) + i));
+    }
+  }
+}
@@ -0,0 +1,291 @@
+#include "stdafx.h"
+#include "Lookahead.h"
+#include "ShadowProblem.h"
+#include "Stats.h"
+
+template<typename TIdx> Lookahead<TIdx>::Lookahead(const Problem<TIdx> &cur, const bool bTrail,
+  const Heuristic heuristic, const uint64_t seed, const std::atomic<bool> *pStop) : _pCur(&cur), _bTrail(bTrail),
+  _heuristic(heuristic), _seed(seed), _pStop(pStop), _kStarts(longStarts(cur)),
+  _nCandidates(cur._cl3.size() * 3 + _kStarts.back())
+{
+  _bestTotCl3 = (cur.NonBinaryCount() + 1) * 2;
+  _assignOutcome.reset(new std::atomic<int64_t>[2 * cur._vrc._N + 1]());
+}
+
+template<typename TIdx> std::vector<int64_t> Lookahead<TIdx>::longStarts(const Problem<TIdx> &cur) {
+  std::vector<int64_t> starts(cur._clk.size() + 1);
+  starts[0] = 0;
+  for (int64_t i = 0; i < cur._clk.size(); i++) {
+    starts[i + 1] = starts[i] + cur._clk[i]._size;
+  }
+  return starts;
+}
+
+template<typename TIdx> void Lookahead<TIdx>::locate(const int64_t iCandidate, bool &bLong, int64_t &iClause,
+  int64_t &j) const
+{
+  const int64_t nCandidates3 = _pCur->_cl3.size() * 3;
+  bLong = (iCandidate >= nCandidates3);
+  if (!bLong) {
+    iClause = iCandidate / 3;
+    j = iCandidate % 3;
+    return;
+  }
+  const int64_t at = iCandidate - nCandidates3;
+  iClause = int64_t(std::upper_bound(_kStarts.begin(), _kStarts.end(), at) - _kStarts.begin()) - 1;
+  j = at - _kStarts[iClause];
+}
+
+template<typename TIdx> int64_t Lookahead<TIdx>::candidateLit(const int64_t iCandidate) const {
+  bool bLong;
+  int64_t i, j;
+  locate(iCandidate, bLong, i, j);
+  return bLong ? _pCur->LitK(i, j) : _pCur->_cl3[i]._vars[j];
+}
+
+template<typename TIdx> uint64_t Lookahead<TIdx>::tieKey(const int64_t iCandidate) const {
+  if (_heuristic != Heuristic::RandomTies) {
+    return uint64_t(iCandidate);
+  }
+  // The finalizer of SplitMix64, varied by the node so that the ties aren't broken alike in each node.
+  uint64_t z = uint64_t(iCandidate) ^ _seed ^ (uint64_t(_pCur->_nKnown) * 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+template<typename TIdx> int64_t Lookahead<TIdx>::pickByOccurrence() const {
+  const Problem<TIdx> &cur = *_pCur;
+  auto weight = [&](const int64_t lit) {
+    return 2 * cur._vr2.Size(lit, cur) + cur._vr3.Size(lit, cur) + cur._vrk.Size(lit, cur);
+  };
+  int64_t iBest = 0;
+  int64_t bestBoth = -1, bestOwn = -1;
+  for (int64_t iCandidate = 0; iCandidate < _nCandidates; iCandidate++) {
+    const int64_t lit = candidateLit(iCandidate);
+    const int64_t own = weight(lit);
+    const int64_t other = weight(-lit);
+    // Prefer the variables occurring often in both signs, so that both branches get simpler.
+    const int64_t both = own * other + own + other;
+    if (both > bestBoth || (both == bestBoth && own > bestOwn)) {
+      iBest = iCandidate;
+      bestBoth = both;
+      bestOwn = own;
+    }
+  }
+  return iBest;
+}
+
+template<typename TIdx> int64_t Lookahead<TIdx>::probeAssign(ShadowProblem<TIdx> &shadow, Problem<TIdx> &prob,
+  const int64_t lit)
+{
+  shadow.Restore();
+  // Single-signed variables of the satisfied clauses are eliminated inside.
+  if (!prob.ApplyVar(lit) || !prob.Check2Sat()) {
+    return -1;
+  }
+  return prob.NonBinaryCount() + 1;
+}
+
+template<typename TIdx> void Lookahead<TIdx>::Run() {
+  const Problem<TIdx> &cur = *_pCur;
+  Problem<TIdx> left = cur;
+  Problem<TIdx> right = cur;
+  ShadowProblem<TIdx> shadowLeft(cur, left, _bTrail);
+  ShadowProblem<TIdx> shadowRight(cur, right, _bTrail);
+
+  Problem<TIdx> bestLeft, bestRight;
+  bool maybeBestLeft = false, maybeBestRight = false;
+  Clause2<TIdx> bestLeftAdded = {};
+  int64_t bestLit = 0;
+  int64_t bestTotCl3 = (cur.NonBinaryCount() + 1) * 2;
+  uint64_t bestTieKey = UINT64_MAX;
+  std::vector<int64_t> forced;
+  // Returns the outcome of assigning the literal, probing it unless done already. |bCurrent| tells whether |prob|
+  //   holds the result of the probe.
+  auto assignOutcome = [&](const int64_t lit, ShadowProblem<TIdx> &shadow, Problem<TIdx> &prob, bool &bCurrent) {
+    std::atomic<int64_t> &outcome = _assignOutcome[cur._vrc._N + lit];
+    int64_t res = outcome.load(std::memory_order_relaxed);
+    bCurrent = false;
+    if (res == 0) {
+      res = probeAssign(shadow, prob, lit);
+      bCurrent = true;
+      // Another thread may have probed the same literal meanwhile, with the same outcome.
+      if (outcome.exchange(res, std::memory_order_relaxed) == 0 && res < 0) {
+        forced.push_back(-lit);
+      }
+    }
+    return res;
+  };
+  auto evaluate = [&](const int64_t iCandidate) {
+    bool bLong;
+    int64_t i, j;
+    locate(iCandidate, bLong, i, j);
+    int64_t totCl3 = 0;
+    bool maybeLeft = false;
+    const int64_t lit = bLong ? cur.LitK(i, j) : cur._cl3[i]._vars[j];
+
+    // The left branch of a 3-clause keeps the other two literals, while that of a long clause assigns the
+    //   literal false, as the rest of a long clause constrains little.
+    bool bLeftCurrent = true;
+    if (bLong) {
+      const int64_t leftCl3 = assignOutcome(-lit, shadowLeft, left, bLeftCurrent);
+      maybeLeft = (leftCl3 > 0);
+      if (maybeLeft) {
+        totCl3 += leftCl3 - 1;
+      }
+    }
+    else {
+      shadowLeft.Restore();
+      left.AddClause2(cur._cl3[i]._vars[j == 0 ? 1 : 0], cur._cl3[i]._vars[j == 2 ? 1 : 2]);
+      left.RemoveClause3(i);
+      if (left.ActSingleSigned(lit) && left.Check2Sat()) {
+        totCl3 += left.NonBinaryCount();
+        maybeLeft = true;
+      }
+      else {
+        // The left branch covers all the solutions with the literal false.
+        forced.push_back(lit);
+      }
+    }
+
+    bool bRightCurrent;
+    const int64_t rightCl3 = assignOutcome(lit, shadowRight, right, bRightCurrent);
+    const bool maybeRight = (rightCl3 > 0);
+    if (maybeRight) {
+      totCl3 += rightCl3 - 1;
+    }
+    if (!maybeLeft && !maybeRight) {
+      return;
+    }
+    const uint64_t key = tieKey(iCandidate);
+    if (totCl3 < bestTotCl3 || (totCl3 == bestTotCl3 && key < bestTieKey)) {
+      maybeBestLeft = maybeLeft;
+      if (maybeLeft) {
+        if (!bLeftCurrent) {
+          probeAssign(shadowLeft, left, -lit);
+        }
+        bestLeft = left;
+      }
+      bestLeftAdded = Clause2<TIdx>{};
+      if (!bLong) {
+        bestLeftAdded._vars[0] = cur._cl3[i]._vars[j == 0 ? 1 : 0];
+        bestLeftAdded._vars[1] = cur._cl3[i]._vars[j == 2 ? 1 : 2];
+      }
+      maybeBestRight = maybeRight;
+      if (maybeRight) {
+        if (!bRightCurrent) {
+          probeAssign(shadowRight, right, lit);
+        }
+        bestRight = right;
+      }
+      bestLit = lit;
+      bestTotCl3 = totCl3;
+      bestTieKey = key;
+    }
+  };
+
+  if (_heuristic == Heuristic::MaxOccurrence) {
+    // A single candidate, evaluated by the owner of the scan.
+    if (_nCandidates > 0 && _iNext.exchange(_nCandidates, std::memory_order_relaxed) < _nCandidates) {
+      Stats::Local().Add(WorkerStats::cProbes, 1);
+      evaluate(pickByOccurrence());
+    }
+  }
+  else {
+    for (;;) {
+      if (_pStop != nullptr && _pStop->load(std::memory_order_relaxed)) {
+        break;
+      }
+      const int64_t iFirst = _iNext.fetch_add(_cBlockCandidates, std::memory_order_relaxed);
+      if (iFirst >= _nCandidates) {
+        break;
+      }
+      const int64_t iLimit = std::min(iFirst + _cBlockCandidates, _nCandidates);
+      Stats::Local().Add(WorkerStats::cProbes, iLimit - iFirst);
+      for (int64_t iCandidate = iFirst; iCandidate < iLimit; iCandidate++) {
+        evaluate(iCandidate);
+      }
+    }
+  }
+
+  //// Merge into the best candidate of the scan
+  std::unique_lock<std::mutex> lock(_sync);
+  _forced.insert(forced.begin(), forced.end());
+  if (bestTotCl3 < _bestTotCl3 || (bestTotCl3 == _bestTotCl3 && bestTieKey < _bestTieKey)) {
+    _maybeBestLeft = maybeBestLeft;
+    if (maybeBestLeft) {
+      _bestLeft = std::move(bestLeft);
+      _bestLeft._pShadow = nullptr;
+    }
+    _bestLeftAdded = bestLeftAdded;
+    _bestLit = bestLit;
+    _maybeBestRight = maybeBestRight;
+    if (maybeBestRight) {
+      _bestRight = std::move(bestRight);
+      _bestRight._pShadow = nullptr;
+    }
+    _bestTotCl3 = bestTotCl3;
+    _bestTieKey = bestTieKey;
+  }
+}
+
+template<typename TIdx> bool Lookahead<TIdx>::ApplyForced(Problem<TIdx> &child) const {
+  for (const int64_t lit : _forced) {
+    // A single-signed variable may have been eliminated in the child with the opposite value, but then the child
+    //   has no solutions, because the node has none with that value.
+    if (!child.ApplyVar(lit)) {
+      return false;
+    }
+  }
+  Stats::Local().Add(WorkerStats::cForcedLits, _forced.size());
+  return child.Check2Sat();
+}
+
+template<typename TIdx> void LookaheadBoard<TIdx>::Post(Lookahead<TIdx> &la) {
+  SyncLock<TSync> sl(_sync);
+  _posted.push_back(&la);
+}
+
+template<typename TIdx> void LookaheadBoard<TIdx>::Withdraw(Lookahead<TIdx> &la) {
+  {
+    SyncLock<TSync> sl(_sync);
+    for (size_t i = 0; i < _posted.size(); i++) {
+      if (_posted[i] == &la) {
+        _posted[i] = _posted.back();
+        _posted.pop_back();
+        break;
+      }
+    }
+  }
+  // No new helpers can join after the withdrawal.
+  while (la._nHelpers.load(std::memory_order_acquire) > 0) {
+    std::this_thread::yield();
+  }
+}
+
+template<typename TIdx> bool LookaheadBoard<TIdx>::Help() {
+  Lookahead<TIdx> *pLa = nullptr;
+  {
+    SyncLock<TSync> sl(_sync);
+    for (size_t i = 0; i < _posted.size(); i++) {
+      if (_posted[i]->HasCandidates()) {
+        pLa = _posted[i];
+        // Under the lock, so that Withdraw() can't miss this helper.
+        pLa->_nHelpers.fetch_add(1, std::memory_order_relaxed);
+        break;
+      }
+    }
+  }
+  if (pLa == nullptr) {
+    return false;
+  }
+  pLa->Run();
+  pLa->_nHelpers.fetch_sub(1, std::memory_order_release);
+  return true;
+}
+
+template struct Lookahead<int32_t>;
+template struct Lookahead<int64_t>;
+template class LookaheadBoard<int32_t>;
+template class LookaheadBoard<int64_t>;
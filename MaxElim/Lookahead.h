@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Problem.h"
+#include "SpinLock.h"
+
+// The branching rules of the search.
+enum class Heuristic : int8_t {
+  // Probes all the candidates, and picks the one leaving the fewest clauses of 3 literals or more in the two
+  //   branches.
+  MinTotCl3,
+  // Picks the literal with the most weighted occurrences, and probes only it.
+  MaxOccurrence,
+  // As MinTotCl3, but breaks the ties pseudo-randomly instead of by the earliest candidate.
+  RandomTies
+};
+
+// The candidate scan of one node. The candidates are claimed in blocks, so that idle workers can join the scan
+//   of a busy worker, each with its own scratch problems.
+template<typename TIdx> struct Lookahead {
+  static const int64_t _cBlockCandidates = 16;
+
+  const Problem<TIdx> *_pCur;
+  const bool _bTrail;
+  const Heuristic _heuristic;
+  const uint64_t _seed;
+  // The scan stops early once this is set, e.g. when another worker has found a solution.
+  const std::atomic<bool> *_pStop;
+  // The first candidate of each long clause, less those of the 3-clauses, and the total at the end.
+  const std::vector<int64_t> _kStarts;
+  // A candidate is a literal occurrence: 3-clause index times 3 plus the position in the clause, followed by the
+  //   occurrences in the long clauses.
+  const int64_t _nCandidates;
+  std::atomic<int64_t> _iNext = 0;
+  // The number of helper threads currently scanning.
+  std::atomic<int64_t> _nHelpers = 0;
+
+  // The outcome of assigning each literal, indexed by the literal plus N: 0 if not probed yet, -1 if the literal
+  //   has failed, otherwise 1 plus the number of the clauses of 3 literals or more left. This is the right probe,
+  //   which satisfies the clause of the occurrence anyway, and the left probe of a long clause, so it's done once
+  //   per literal rather than per occurrence.
+  std::unique_ptr<std::atomic<int64_t>[]> _assignOutcome;
+
+  std::mutex _sync;
+  // The literals implied by the problem, found as the negations of the failed literals and as the literals whose
+  //   left branch has failed. Sorted, so that the children don't depend on the number of threads.
+  std::set<int64_t> _forced;
+  // The best candidate found so far. Among the candidates with equal totCl3, the one with the least tie key wins,
+  //   so that the result doesn't depend on the number of threads.
+  int64_t _bestTotCl3;
+  uint64_t _bestTieKey = UINT64_MAX;
+  Problem<TIdx> _bestLeft, _bestRight;
+  bool _maybeBestLeft = false, _maybeBestRight = false;
+  // The literal of the best candidate, which its right branch assigns.
+  int64_t _bestLit = 0;
+  // The 2-clause added by the left branch of the best candidate, or zeros if the branch assigns instead.
+  Clause2<TIdx> _bestLeftAdded = {};
+
+  Lookahead(const Problem<TIdx> &cur, const bool bTrail, const Heuristic heuristic = Heuristic::MinTotCl3,
+    const uint64_t seed = 0, const std::atomic<bool> *pStop = nullptr);
+
+  bool HasCandidates() const {
+    return _iNext.load(std::memory_order_relaxed) < _nCandidates;
+  }
+
+  // Returns |false| if the problem is unsatisfiable.
+  bool MaybeSat() const {
+    return _bestTotCl3 < (_pCur->NonBinaryCount() + 1) * 2;
+  }
+
+  // Evaluates blocks of candidates until none are left.
+  void Run();
+
+  // Applies the forced literals to a child of the node.
+  // Returns |false| if the child is unsatisfiable.
+  bool ApplyForced(Problem<TIdx> &child) const;
+
+private:
+  static std::vector<int64_t> longStarts(const Problem<TIdx> &cur);
+  // Finds the clause and the position in it of the candidate. |bLong| tells a long clause from a 3-clause.
+  void locate(const int64_t iCandidate, bool &bLong, int64_t &iClause, int64_t &j) const;
+  int64_t candidateLit(const int64_t iCandidate) const;
+  uint64_t tieKey(const int64_t iCandidate) const;
+  // Returns the candidate of the literal with the most occurrences, weighting the 2-clauses double.
+  int64_t pickByOccurrence() const;
+  // Returns the outcome of assigning the literal, leaving the result in |prob|.
+  static int64_t probeAssign(ShadowProblem<TIdx> &shadow, Problem<TIdx> &prob, const int64_t lit);
+};
+
+// The scans that idle workers can join.
+template<typename TIdx> class LookaheadBoard {
+  typedef SpinSync<1 << 5> TSync;
+
+  TSync _sync;
+  std::vector<Lookahead<TIdx>*> _posted;
+
+public:
+  void Post(Lookahead<TIdx> &la);
+  // Waits for the helpers to finish.
+  void Withdraw(Lookahead<TIdx> &la);
+
+  // Returns |true| if the calling thread has helped some scan.
+  bool Help();
+};
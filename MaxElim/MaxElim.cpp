@@ -1,320 +1,427 @@
 #include "stdafx.h"
-#include "RawClause.h"
-#include "Problem.h"
-#include "Solver2Sat.h"
-#include "Pipeline.h"
-#include "ShadowProblem.h"
+#include "DimacsLoader.h"
+#include "Solver.h"
+#include "Coordinator.h"
+#include "Stats.h"
 using namespace std;
 
-const char* const gcInpFn = "input.3cnf";
-const char* const gcOutFn = "output.txt";
-char gBuf[1 << 10];
+const char* gpInpFn = "input.3cnf";
+const char* gpOutFn = "output.txt";
+// The file for the counters of the run, if any.
+const char* gpStatsFn = nullptr;
+// The period of printing the counters to stderr, or 0 for none.
+double gStatsPeriodSec = 0;
 
-int64_t gnUsedVars = -1;
-Problem gInitial;
-Pipeline<Problem> problems;
-mutex gmSolution;
-const bool gbSelfCheck = true;
+// The lookahead search over the frontier of problems, or conflict-driven clause learning in a single thread.
+bool gbCdcl = false;
+// Simplify the clauses before the search.
+bool gbPreprocess = true;
+// Roll the probes back with the undo trail rather than the dirty bitmaps.
+bool gbUndoTrail = false;
+// The heuristics of the portfolio: the workers are split between them, each running a complete search.
+vector<Heuristic> gHeuristics = { Heuristic::MinTotCl3 };
+// The budgets of the run, or 0 for none. When one is exceeded, the answer is Unknown.
+double gTimeLimitSec = 0;
+int64_t gMemoryLimitMB = 0;
+int64_t gFrontierLimit = 0;
+// The memory budget of the frontier, beyond which it spills to a scratch file in the directory, or 0 for none.
+int64_t gFrontierMemoryMB = 0;
+const char* gpSpillDir = "";
+// The count of the worker processes solving the cubes of the lookahead, or 0 to solve in this process.
+int64_t gnProcesses = 0;
+// The count of the branching literals of each cube, and the count of the cubes to expand to, or 0 for no limit.
+//   Without either, the depth is |cDefaultCubeDepth|.
+const int64_t cDefaultCubeDepth = 8;
+int64_t gCubeDepth = -1;
+int64_t gMinCubes = 0;
+// Solve the cubes read from the standard input, as a worker process of the coordinator.
+bool gbCubeWorker = false;
+// Write the cubes of the lookahead to the file instead of solving them.
+const char* gpCubesOutFn = nullptr;
+// Solve each cube of the file under assumptions.
+const char* gpCubesInFn = nullptr;
+// The options passed to the worker processes.
+vector<string> gWorkerArgs;
 
-void CheckAndPrintSolution(const Problem& cur) {
-  //// Check
-  int64_t failureClause = -1;
-  for (int64_t i = 0; i < int64_t(gInitial._cl3.size()); i++) {
-    bool satisfied = false;
-    for (int8_t j = 0; j < 3; j++) {
-      const int64_t signedVar = gInitial._cl3[i]._vars[j];
-      if (signedVar == 0) {
+// Solves the cubes read as "a <literals> 0" lines until the end of |in| or a satisfiable cube, answering each on
+//   the standard output with "s SAT" followed by "v <literals> 0", with "s UNSAT" or with "s UNKNOWN", see
+//   Coordinator. Returns Sat with the model of the cube, Unsat if all the cubes are unsatisfiable, otherwise Unknown.
+template<typename TIdx> SolveResult SolveCubes(Solver<TIdx> &solver, istream &in, vector<bool> &model) {
+  bool bUnknown = false;
+  string line;
+  while (getline(in, line)) {
+    if (line.empty() || line[0] != 'a') {
+      continue; // comments, and the header and the clauses of an iCNF file, which come from the input instead
+    }
+    vector<int64_t> cube;
+    const char *p = line.c_str() + 1;
+    char *pEnd = nullptr;
+    for (;;) {
+      const int64_t lit = strtoll(p, &pEnd, 10);
+      if (pEnd == p || lit == 0) {
         break;
       }
-      const int64_t absVar = abs(signedVar);
-      if (cur._varVal[absVar] == Problem::SignToBool(signedVar)) {
-        satisfied = true;
-        break;
+      cube.push_back(lit);
+      p = pEnd;
+    }
+    const SolveResult result = solver.Solve(cube);
+    if (result == SolveResult::Sat) {
+      if (solver.FailedClause() >= 0) {
+        fprintf(stderr, "Check failed at %lld!!!!!\n", solver.FailedClause());
+      }
+      model.assign(solver.VarCount() + 1, false);
+      printf("s SAT\nv");
+      for (int64_t i = 1; i <= solver.VarCount(); i++) {
+        model[i] = solver.Value(i);
+        printf(" %lld", model[i] ? i : -i);
       }
+      printf(" 0\n");
+      fflush(stdout);
+      return SolveResult::Sat;
     }
-    if (!satisfied) {
-      failureClause = i;
-      break;
+    bUnknown = bUnknown || (result == SolveResult::Unknown);
+    printf(result == SolveResult::Unsat ? "s UNSAT\n" : "s UNKNOWN\n");
+    fflush(stdout);
+  }
+  return bUnknown ? SolveResult::Unknown : SolveResult::Unsat;
+}
+
+// Sets the values of the variables from the literals of a "v" line, each variable up to |nVars| exactly once.
+// Returns |false| if a literal is out of range, a variable repeats or one is missing.
+bool ModelFromLits(const vector<int64_t> &lits, const int64_t nVars, vector<bool> &model) {
+  model.assign(nVars + 1, false);
+  vector<bool> seen(nVars + 1, false);
+  for (const int64_t lit : lits) {
+    if (lit == 0 || abs(lit) > nVars || seen[abs(lit)]) {
+      return false;
     }
+    seen[abs(lit)] = true;
+    model[abs(lit)] = (lit > 0);
   }
+  return int64_t(lits.size()) == nVars;
+}
 
-  //// Print
-  unique_lock<mutex> msl(gmSolution);
-  FILE *fpout = fopen(gcOutFn, "wt");
-  for (int64_t i = 1; i < int64_t(cur._varVal.size()); i++) {
-    fprintf(fpout, "%d ", cur._varVal[i] ? 1 : 0);
+// Writes the cubes as "a <literals> 0" lines. Returns |false| if the file can't be written.
+bool WriteCubes(const vector<vector<int64_t>> &cubes) {
+  FILE *fp = fopen(gpCubesOutFn, "wt");
+  if (fp == nullptr) {
+    fprintf(stderr, "Cannot create %s\n", gpCubesOutFn);
+    return false;
   }
-  fprintf(fpout, "\n");
-  if (failureClause >= 0) {
-    fprintf(fpout, "Check failed at %lld!!!!!\n", failureClause);
+  for (const vector<int64_t> &cube : cubes) {
+    fprintf(fp, "a");
+    for (const int64_t lit : cube) {
+      fprintf(fp, " %lld", lit);
+    }
+    fprintf(fp, " 0\n");
   }
-  fclose(fpout);
-  quick_exit(0);
+  const bool bWritten = !ferror(fp);
+  if (fclose(fp) != 0 || !bWritten) {
+    fprintf(stderr, "Cannot write %s\n", gpCubesOutFn);
+    return false;
+  }
+  return true;
 }
 
-void Worker() {
-  Problem cur;
-  while (problems.Pop(cur)) {
-    if (gbSelfCheck) {
-      for (int64_t i = 0; i < int64_t(cur._cl3.size()); i++) {
-        for (int8_t j = 0; j < 3; j++) {
-          const int64_t var = cur._cl3[i]._vars[j];
-          if(!cur._vr3.Contains(var, i, cur)) {
-            fprintf(stderr, "Checking failed for variable %lld in 3-clause %lld.\n", var, i);
-          }
+// Returns the exit code of the process.
+template<typename TIdx> int Solve(DimacsLoader &loader, const int64_t nWorkers) {
+  Solver<TIdx> solver(nWorkers);
+  solver.SetHeuristics(gHeuristics);
+  solver.SetCdcl(gbCdcl);
+  solver.SetPreprocess(gbPreprocess);
+  solver.SetUndoTrail(gbUndoTrail);
+  solver.SetTimeLimit(gTimeLimitSec);
+  solver.SetMemoryLimit(gMemoryLimitMB << 20);
+  solver.SetFrontierLimit(gFrontierLimit);
+  solver.SetFrontierMemory(gFrontierMemoryMB << 20, gpSpillDir);
+  const int loadErr = solver.Load(loader);
+  if (loadErr != 0) {
+    return loadErr;
+  }
+  SolveResult result;
+  // The model of the cubes comes from Solve() under the cube, which has checked it, or from a worker process, whose
+  //   model is checked here.
+  vector<bool> model;
+  if (gbCubeWorker) {
+    SolveCubes(solver, cin, model);
+    return 0;
+  }
+  if (gpCubesInFn != nullptr) {
+    ifstream cubesIn(gpCubesInFn);
+    if (!cubesIn) {
+      fprintf(stderr, "Cannot open %s\n", gpCubesInFn);
+      return 6;
+    }
+    result = SolveCubes(solver, cubesIn, model);
+  }
+  else if (gnProcesses > 0 || gpCubesOutFn != nullptr) {
+    vector<vector<int64_t>> cubes;
+    result = solver.MakeCubes(gCubeDepth, gMinCubes, cubes);
+    if (gpCubesOutFn != nullptr) {
+      // The cubes of the file answer the problem together: none if it's unsatisfiable, and the model if found.
+      if (result == SolveResult::Sat) {
+        cubes.assign(1, vector<int64_t>());
+        for (int64_t i = 1; i <= solver.VarCount(); i++) {
+          cubes[0].push_back(solver.Value(i) ? i : -i);
         }
       }
-      for (int64_t i = 0; i < int64_t(cur._cl2.size()); i++) {
-        for (int8_t j = 0; j < 2; j++) {
-          const int64_t var = cur._cl2[i]._vars[j];
-          if (!cur._vr2.Contains(var, i, cur)) {
-            fprintf(stderr, "Checking failed for variable %lld in 2-clause %lld.\n", var, i);
+      if (!WriteCubes(cubes)) {
+        return 6;
+      }
+    }
+    else if (result == SolveResult::Unknown) {
+      Coordinator coordinator(gWorkerArgs, gnProcesses);
+      vector<int64_t> lits;
+      result = coordinator.Solve(cubes, lits);
+      if (result == SolveResult::Sat) {
+        if (!ModelFromLits(lits, solver.VarCount(), model)) {
+          fprintf(stderr, "A worker has answered with a malformed model.\n");
+          result = SolveResult::Unknown;
+        }
+        else {
+          const int64_t failed = solver.CheckModel(model);
+          if (failed >= 0) {
+            fprintf(stderr, "The model of a worker fails clause %lld.\n", failed);
+            result = SolveResult::Unknown;
           }
         }
       }
     }
-
-    if (cur._nKnown == gnUsedVars) { // Solution found
-      CheckAndPrintSolution(cur);
-      continue; // should be unreachable
-    }
-    if (cur._cl3.size() == 0) { // reduced to 2-sat problem
-      Solver2Sat s2s(cur);
-      if (!s2s.Solve(cur)) {
-        continue;
-      }
-      CheckAndPrintSolution(cur);
-      continue; // should be unreachable
+  }
+  else {
+    result = solver.Solve();
+  }
+  if (result == SolveResult::Sat && model.empty()) {
+    model.assign(solver.VarCount() + 1, false);
+    for (int64_t i = 1; i <= solver.VarCount(); i++) {
+      model[i] = solver.Value(i);
     }
+  }
 
-    Problem left = cur;
-    Problem right = cur;
-    ShadowProblem shadowLeft(cur, left);
-    ShadowProblem shadowRight(cur, right);
-
-    Problem bestLeft, bestRight;
-    bool maybeBestLeft = false, maybeBestRight = false;
-    int64_t bestTotCl3 = (cur._cl3.size() + 1) * 2;
-    for (int64_t i = 0; i < int64_t(cur._cl3.size()); i++) {
-      for (int8_t j = 0; j < 3; j++) {
-        int64_t totCl3 = 0;
-        bool maybeLeft = false;
-        bool maybeRight = false;
-        
-        shadowLeft.Restore();
-
-        //// DEBUG-PRINT
-        //for (int64_t m = 0; m < cur._vrc._avlNp._nodes.size(); m++) {
-        //  if (memcmp(&cur._vrc._avlNp._nodes[m], &left._vrc._avlNp._nodes[m], sizeof(AVLNode))) {
-        //    printf(" %lld ", m);
-        //  }
-        //}
-
-        left._cl2.emplace_back();
-        int8_t at = 0;
-        Clause2 &cl2back = left._cl2.ModifyBack(&shadowLeft._cl2);
-        for (int8_t k = 0; k < 3; k++) {
-          if (k == j) continue;
-          const int64_t var = cur._cl3[i]._vars[k];
-          cl2back._vars[at] = var;
-          left._vr2.Add(var, left._cl2.size() - 1, left);
-          at++;
-        }
-        left.RemoveClause3(i);
-        if (left.ActSingleSigned(cur._cl3[i]._vars[j])) {
-          Solver2Sat s2s(left);
-          if (s2s.HasSolution()) {
-            totCl3 += left._cl3.size();
-            maybeLeft = true;
-          }
-        }
+  FILE *fpout = fopen(gpOutFn, "wt");
+  if (result == SolveResult::Sat) {
+    for (int64_t i = 1; i <= solver.VarCount(); i++) {
+      fprintf(fpout, "%d ", model[i] ? 1 : 0);
+    }
+    fprintf(fpout, "\n");
+    if (solver.FailedClause() >= 0) {
+      fprintf(fpout, "Check failed at %lld!!!!!\n", solver.FailedClause());
+    }
+  }
+  else if (result == SolveResult::Unsat) {
+    fprintf(fpout, "Unsatisfiable\n");
+  }
+  else {
+    fprintf(fpout, "Unknown\n");
+  }
+  fclose(fpout);
+  const char *const cResultNames[] = { "SAT", "UNSAT", "UNKNOWN" };
+  Stats::Instance().Report(gpStatsFn, cResultNames[int(result)], solver.FrontierHighWater());
+  return 0;
+}
 
-        shadowRight.Restore();
-        right.RemoveClause3(i);
-        if (right.ApplyVar(cur._cl3[i]._vars[j])) {
-          bool maybeSat = true;
-          for (int8_t k = 0; k < 3; k++) {
-            if (k == j) continue;
-            if (!right.ActSingleSigned(cur._cl3[i]._vars[k])) {
-              maybeSat = false;
-              break;
-            }
-          }
-          if (maybeSat) {
-            Solver2Sat s2s(right);
-            maybeSat = s2s.HasSolution();
-          }
-          if(maybeSat) {
-            totCl3 += right._cl3.size();
-            maybeRight = true;
-          }
-        }
-        if ((maybeLeft || maybeRight) && totCl3 < bestTotCl3) {
-          maybeBestLeft = maybeLeft;
-          if (maybeLeft) {
-            bestLeft = left;
-          }
-          maybeBestRight = maybeRight;
-          if (maybeRight) {
-            bestRight = right;
-          }
-          bestTotCl3 = totCl3;
-        }
-      }
+// Returns |false| if a heuristic is unknown.
+bool ParseHeuristics(const char *list) {
+  gHeuristics.clear();
+  string remaining = list;
+  for (;;) {
+    const size_t comma = remaining.find(',');
+    const string name = remaining.substr(0, comma);
+    if (name == "lookahead") {
+      gHeuristics.push_back(Heuristic::MinTotCl3);
     }
-    if (bestTotCl3 >= (int64_t(cur._cl3.size()) + 1) * 2) { // Unsatisfiable
-      continue;
+    else if (name == "occurrence") {
+      gHeuristics.push_back(Heuristic::MaxOccurrence);
     }
-    if (maybeBestLeft) {
-      bestLeft._pShadow = nullptr;
-      problems.Push(bestLeft);
+    else if (name == "random") {
+      gHeuristics.push_back(Heuristic::RandomTies);
     }
-    if (maybeBestRight) {
-      bestRight._pShadow = nullptr;
-      problems.Push(bestRight);
+    else {
+      return false;
     }
+    if (comma == string::npos) {
+      return true;
+    }
+    remaining = remaining.substr(comma + 1);
   }
 }
 
-int main()
+// Narrows the kernels to the instruction set, see Kernels. Returns |false| if it's unknown.
+bool ParseSimd(const char *name) {
+  if (!strcmp(name, "auto")) {
+    Kernels::Select(Kernels::Isa::Avx512);
+    return true;
+  }
+  for (int8_t i = 0; i <= int8_t(Kernels::Isa::Avx512); i++) {
+    if (!strcmp(name, Kernels::IsaName(Kernels::Isa(i)))) {
+      Kernels::Select(Kernels::Isa(i));
+      return true;
+    }
+  }
+  return false;
+}
+
+void PrintUsage() {
+  fprintf(stderr, "Usage: MaxElim [--input <file.3cnf>] [--output <file.txt>] [--threads <count>]"
+    " [--stats <file>] [--stats-period <seconds>] [--portfolio <heuristic,...>]"
+    " [--engine lookahead|cdcl] [--time-limit <seconds>] [--memory-limit <MB>] [--frontier-limit <problems>]"
+    " [--preprocess on|off] [--frontier-memory <MB>] [--spill-dir <directory>] [--processes <count>]"
+    " [--cube-depth <literals>] [--cube-count <cubes>] [--cubes-out <file.icnf>] [--cubes-in <file.icnf>]"
+    " [--simd auto|avx512|avx2|sse2|scalar] [--restore bitmap|trail]\n"
+    "The heuristics are: lookahead, occurrence, random.\n");
+}
+
+int main(int argc, char *argv[])
 {
   SetPriorityClass(GetCurrentProcess(), BELOW_NORMAL_PRIORITY_CLASS);
 
-  int64_t nVars = -1, nClauses = -1;
-  FastVector<Clause3> clauses;
-  {
-    vector<bool> usedVar;
-    ifstream ifs(gcInpFn, ifstream::in);
-    string line;
-    bool bProbDef = false;
-    vector<int64_t> curClause;
-    while (getline(ifs, line)) {
-      if (sscanf(line.c_str(), "%s", gBuf) < 1) {
-        continue; // empty line
+  int64_t nWorkers = thread::hardware_concurrency();
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      PrintUsage();
+      return 7;
+    }
+    if (!strcmp(argv[i], "--input")) {
+      gpInpFn = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--output")) {
+      gpOutFn = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--threads")) {
+      nWorkers = atoll(argv[++i]);
+      if (nWorkers <= 0) {
+        PrintUsage();
+        return 7;
       }
-      if (!_stricmp(gBuf, "c")) {
-        continue; // a comment line
+    }
+    else if (!strcmp(argv[i], "--stats")) {
+      gpStatsFn = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--stats-period")) {
+      gStatsPeriodSec = atof(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--portfolio")) {
+      if (!ParseHeuristics(argv[++i])) {
+        PrintUsage();
+        return 7;
       }
-      if (!_stricmp(gBuf, "p")) {
-        if (bProbDef) {
-          fprintf(stderr, "Duplicate problem definition.\n");
-          return 1;
-        }
-        if (sscanf(line.c_str(), "%*s%s%lld%lld", gBuf, &nVars, &nClauses) != 3) {
-          fprintf(stderr, "Error in problem definition.\n");
-          return 2;
-        }
-        bProbDef = true;
-        usedVar.resize(nVars + 1, false);
-        continue;
+    }
+    else if (!strcmp(argv[i], "--time-limit")) {
+      gTimeLimitSec = atof(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--memory-limit")) {
+      gMemoryLimitMB = atoll(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--frontier-limit")) {
+      gFrontierLimit = atoll(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--frontier-memory")) {
+      gFrontierMemoryMB = atoll(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--spill-dir")) {
+      gpSpillDir = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--processes")) {
+      gnProcesses = atoll(argv[++i]);
+      if (gnProcesses < 0) {
+        PrintUsage();
+        return 7;
       }
-      if (!bProbDef) {
-        fprintf(stderr, "A clause seems to appear before a problem definition.\n");
-        return 3;
+    }
+    else if (!strcmp(argv[i], "--cube-depth")) {
+      gCubeDepth = atoll(argv[++i]);
+      if (gCubeDepth < 0) {
+        PrintUsage();
+        return 7;
       }
-      int64_t pos = 0;
-      for (;;) {
-        int64_t offs;
-        int64_t var;
-        if (sscanf(line.c_str() + pos, "%lld%lln", &var, &offs) != 1) {
-          break;
-        }
-        if (var == 0) {
-          if (curClause.size() > 3) {
-            fprintf(stderr, "Too many variables in a clause: %lld", int64_t(curClause.size()));
-            return 4;
-          }
-          set<int64_t> unique(curClause.begin(), curClause.end());
-          curClause = vector(unique.begin(), unique.end());
-          bool useClause = true;
-          for (int8_t i = 0; i < int8_t(curClause.size()); i++) {
-            for (int8_t j = 0; j < i; j++) {
-              if (curClause[i] == -curClause[j]) {
-                useClause = false;
-                goto useClauseDetermined; // no break level in C/C++
-              }
-            }
-          }
-        useClauseDetermined:
-          if (useClause) {
-            clauses.emplace_back();
-            for (int8_t i = 0; i < int8_t(curClause.size()); i++) {
-              clauses.UnshadowedModifyBack()._vars[i] = curClause[i];
-              usedVar[abs(curClause[i])] = true;
-            }
-            for (int8_t i = int8_t(curClause.size()); i < 3; i++) {
-              clauses.UnshadowedModifyBack()._vars[i] = 0;
-            }
-          }
-          curClause.clear();
-          break;
-        }
-        if (abs(var) > nVars) {
-          fprintf(stderr, "Variable out of range: %lld\n", var);
-          quick_exit(9);
-        }
-        curClause.emplace_back(var);
-        pos += offs;
+    }
+    else if (!strcmp(argv[i], "--cube-count")) {
+      gMinCubes = atoll(argv[++i]);
+      if (gMinCubes < 0) {
+        PrintUsage();
+        return 7;
       }
     }
-    if (int64_t(clauses.size()) != nClauses) {
-      fprintf(stderr, "Read %lld clauses instead of %lld\n", (int64_t)clauses.size(), (int64_t)nClauses);
-      return 5;
+    else if (!strcmp(argv[i], "--cubes-out")) {
+      gpCubesOutFn = argv[++i];
     }
-    gnUsedVars = 0;
-    for (int64_t i = 1; i < nVars; i++) {
-      if (usedVar[i]) {
-        gnUsedVars++;
+    else if (!strcmp(argv[i], "--cubes-in")) {
+      gpCubesInFn = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--simd")) {
+      if (!ParseSimd(argv[++i])) {
+        PrintUsage();
+        return 7;
       }
     }
-  }
-
-  gInitial._varKnown.resize(nVars + 1, false);
-  gInitial._varVal.resize(nVars + 1);
-  gInitial._cl3 = clauses;
-  gInitial._nKnown = 0;
-  gInitial._vrc.Init(nVars);
-  gInitial._vr3.Init(gInitial);
-  for (int64_t i = 0; i < int64_t(gInitial._cl3.size()); i++) {
-    for (int8_t j = 0; j < 3; j++) {
-      const int64_t var = gInitial._cl3[i]._vars[j];
-      if (var == 0) {
-        break;
+    else if (!strcmp(argv[i], "--cube-worker")) {
+      gbCubeWorker = !strcmp(argv[++i], "on");
+    }
+    else if (!strcmp(argv[i], "--engine")) {
+      i++;
+      if (!strcmp(argv[i], "cdcl")) {
+        gbCdcl = true;
+      }
+      else if (strcmp(argv[i], "lookahead")) {
+        PrintUsage();
+        return 7;
+      }
+    }
+    else if (!strcmp(argv[i], "--restore")) {
+      i++;
+      if (!strcmp(argv[i], "trail")) {
+        gbUndoTrail = true;
+      }
+      else if (strcmp(argv[i], "bitmap")) {
+        PrintUsage();
+        return 7;
+      }
+    }
+    else if (!strcmp(argv[i], "--preprocess")) {
+      i++;
+      if (!strcmp(argv[i], "off")) {
+        gbPreprocess = false;
       }
-      //printf("%lld %d %lld\n", i, (int)j, var); // DEBUG-PRINT
-      //if (i == 533) {
-      //  printf("");
-      //}
-      gInitial._vr3.Add(var, i, gInitial);
-      if (!gInitial._vr3.Contains(var, i, gInitial)) {
-        fprintf(stderr, "Failed to mark variable %lld in clause %lld\n", var, i);
+      else if (strcmp(argv[i], "on")) {
+        PrintUsage();
+        return 7;
       }
     }
+    else {
+      PrintUsage();
+      return 7;
+    }
   }
-  gInitial._vr2.Init(gInitial);
-
-  Problem normalized = gInitial;
-  if (!normalized.NormalizeInput()) {
-    FILE *fpout = fopen(gcOutFn, "wt");
-    fprintf(fpout, "Unsatisfiable\n");
-    fclose(fpout);
-    return 0;
+  if (gCubeDepth < 0 && gMinCubes == 0) {
+    gCubeDepth = cDefaultCubeDepth;
+  }
+  if (gnProcesses > 0) {
+    // The workers get the options of the search, and split the threads between them.
+    for (int i = 1; i + 1 < argc; i += 2) {
+      const char *const cCoordinatorOnly[] = { "--output", "--threads", "--stats", "--stats-period", "--processes",
+        "--cube-depth", "--cube-count", "--cubes-out", "--cubes-in" };
+      if (none_of(begin(cCoordinatorOnly), end(cCoordinatorOnly), [&](const char *name) {
+        return !strcmp(argv[i], name); }))
+      {
+        gWorkerArgs.push_back(argv[i]);
+        gWorkerArgs.push_back(argv[i + 1]);
+      }
+    }
+    gWorkerArgs.push_back("--threads");
+    gWorkerArgs.push_back(to_string(max<int64_t>(1, nWorkers / gnProcesses)));
   }
-  
-  const int64_t nWorkers = thread::hardware_concurrency();
-  problems.SetWorkerCount(nWorkers);
-  problems.Push(normalized);
-  vector<thread> workers;
-  for (int64_t i = 0; i < nWorkers; i++) {
-    workers.emplace_back(&Worker);
+  Stats::Instance().StartDumps(gStatsPeriodSec);
+  DimacsLoader loader;
+  const int openErr = loader.Open(gpInpFn);
+  if (openErr != 0) {
+    return openErr;
   }
-  for (int64_t i = 0; i < nWorkers; i++) {
-    workers[i].join();
+  if (FitsInt32(loader._nVars, loader._nClauses)) {
+    const int exitCode = Solve<int32_t>(loader, nWorkers);
+    // The long clauses may need the wider indices after all.
+    if (exitCode != Solver<int32_t>::_cExitNeedsInt64) {
+      return exitCode;
+    }
   }
-
-  FILE *fpout = fopen(gcOutFn, "wt");
-  fprintf(fpout, "Unsatisfiable\n");
-  fclose(fpout);
-  return 0;
+  return Solve<int64_t>(loader, nWorkers);
 }
-
@@ -2,3 +2,110 @@
 #include "MemPool.h"
 
 thread_local MemPool MemPool::_instance;
+const int64_t MemPool::_cSmallBytes[MemPool::_cnSmallClasses] = { 32, 64, 96, 128, 192, 256, 384, 512, 768, 1024,
+  1536, 2048 };
+const int8_t MemPool::_cSmallClassOf[MemPool::_cMaxSmallBytes / MemPool::_cAlignment] = {
+  0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, // up to 512 bytes
+  8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9, // up to 1024 bytes
+  10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, // up to 1536 bytes
+  11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11 }; // up to 2048 bytes
+MemPool::CentralList MemPool::_central[MemPool::_cnClasses];
+std::atomic<int64_t> MemPool::_nCentralBytes(0);
+std::atomic<int64_t> MemPool::_nOsBytes(0);
+
+void* MemPool::osAcquire(const int64_t nBytes) {
+  void *ans = _mm_malloc(nBytes, _cAlignment);
+  if (ans == nullptr) {
+    __debugbreak();
+  }
+  _nOsBytes.fetch_add(nBytes, std::memory_order_relaxed);
+  return ans;
+}
+
+void MemPool::osRelease(void *pMem, const int64_t nBytes) {
+  _mm_free(pMem);
+  _nOsBytes.fetch_sub(nBytes, std::memory_order_relaxed);
+}
+
+void* MemPool::refill(const int64_t iClass) {
+  CentralList &central = _central[iClass];
+  BatchHead *pBatch;
+  {
+    SyncLock<TSync> sl(central._sync);
+    pBatch = central._pFirst;
+    if (pBatch == nullptr) {
+      return nullptr;
+    }
+    central._pFirst = pBatch->_pNextBatch;
+    central._nBlocks -= pBatch->_nBlocks;
+  }
+  const int64_t nBlocks = pBatch->_nBlocks;
+  _nCentralBytes.fetch_sub(nBlocks * blockBytes(iClass), std::memory_order_relaxed);
+  Stats::Local().Add(WorkerStats::cPoolRefills, nBlocks);
+  // The cache is empty, so the batch becomes the whole cache.
+  _heads[iClass] = pBatch;
+  _nCached[iClass] = nBlocks;
+  return pBatch;
+}
+
+void MemPool::spill(const int64_t iClass, const int64_t nBlocks) {
+  //// Detach the first |nBlocks| blocks of the cache
+  void *pFirst = _heads[iClass];
+  void *pLast = pFirst;
+  for (int64_t i = 1; i < nBlocks; i++) {
+    pLast = *reinterpret_cast<void**>(pLast);
+  }
+  _heads[iClass] = *reinterpret_cast<void**>(pLast);
+  *reinterpret_cast<void**>(pLast) = nullptr;
+  _nCached[iClass] -= nBlocks;
+
+  //// Reserve the bytes under the cap of the central tier. The blocks of the small classes can't be freed one by
+  //   one, so they are always accepted, though they count towards the cap.
+  const int64_t nBytes = nBlocks * blockBytes(iClass);
+  const int64_t nCentralBytes = _nCentralBytes.fetch_add(nBytes, std::memory_order_relaxed) + nBytes;
+  if (iClass < _cnSmallClasses || nCentralBytes <= _cCentralBytes) {
+    CentralList &central = _central[iClass];
+    BatchHead *pBatch = reinterpret_cast<BatchHead*>(pFirst);
+    pBatch->_nBlocks = nBlocks;
+    {
+      SyncLock<TSync> sl(central._sync);
+      pBatch->_pNextBatch = central._pFirst;
+      central._pFirst = pBatch;
+      central._nBlocks += nBlocks;
+    }
+    Stats::Local().Add(WorkerStats::cPoolSpills, nBlocks);
+    return;
+  }
+  _nCentralBytes.fetch_sub(nBytes, std::memory_order_relaxed);
+  // The central tier is full: return the batch to the OS.
+  void *pCur = pFirst;
+  while (pCur != nullptr) {
+    void *pNext = *reinterpret_cast<void**>(pCur);
+    osRelease(pCur, blockBytes(iClass));
+    pCur = pNext;
+  }
+  Stats::Local().Add(WorkerStats::cPoolTrims, nBlocks);
+}
+
+void* MemPool::carve(const int64_t iClass) {
+  char *pSlab = reinterpret_cast<char*>(osAcquire(_cSlabBytes));
+  const int64_t nBytes = blockBytes(iClass);
+  const int64_t nBlocks = _cSlabBytes / nBytes;
+  // The cache is empty, so the rest of the slab becomes the whole cache.
+  for (int64_t i = 1; i + 1 < nBlocks; i++) {
+    *reinterpret_cast<void**>(pSlab + i * nBytes) = pSlab + (i + 1) * nBytes;
+  }
+  *reinterpret_cast<void**>(pSlab + (nBlocks - 1) * nBytes) = nullptr;
+  _heads[iClass] = pSlab + nBytes;
+  _nCached[iClass] = nBlocks - 1;
+  return pSlab;
+}
+
+MemPool::~MemPool() {
+  // Hand the cache of the exiting thread over to the other threads.
+  for (int64_t i = 0; i < _cnClasses; i++) {
+    if (_nCached[i] > 0) {
+      spill(i, _nCached[i]);
+    }
+  }
+}
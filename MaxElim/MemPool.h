@@ -1,61 +1,118 @@
 #pragma once
 
-//#include "SpinLock.h"
+#include "SpinLock.h"
+#include "Stats.h"
 
+// A two-tier pool of blocks in size classes. Each thread caches up to a cap of blocks per class, and spills the
+//   excess in batches to the central tier, which any thread refills from. The blocks thus get back to the threads
+//   that need them, even though the problems are freed by other threads than those that acquired them. The central
+//   tier is capped too, over all the classes, and returns the excess of the page classes to the OS.
+// The small classes, up to half a page, are carved from slabs, so that a short vector doesn't cost a whole page.
+//   The slabs are never returned to the OS.
 struct MemPool {
   static const int64_t _cPageSize = 1 << 12;
   static const int64_t _cMaxLenPages = 1 << 12;
   static const int64_t _cAlignment = 1 << 5;
+  // The block sizes of the small classes are multiples of the alignment, growing by about 1.5x.
+  static const int64_t _cnSmallClasses = 12;
+  static const int64_t _cMaxSmallBytes = _cPageSize / 2;
+  static const int64_t _cSlabBytes = 1 << 16;
+  static const int64_t _cnClasses = _cnSmallClasses + _cMaxLenPages;
+  // The cache cap of a thread for each class, in bytes, and the minimum in blocks.
+  static const int64_t _cCacheBytes = 1 << 22;
+  static const int64_t _cMinCacheBlocks = 4;
+  // The cap of the central tier over all the classes, in bytes.
+  static const int64_t _cCentralBytes = 1 << 26;
 
 private:
-  //typedef SpinSync<1 << 5> TSync;
+  typedef SpinSync<1 << 5> TSync;
+
+  // A batch of blocks linked through their first words. The head block also links to the next batch and holds the
+  //   number of blocks in its batch.
+  struct BatchHead {
+    void *_pNextBlock;
+    BatchHead *_pNextBatch;
+    int64_t _nBlocks;
+  };
+
+  struct alignas(64) CentralList {
+    TSync _sync;
+    BatchHead *_pFirst = nullptr;
+    int64_t _nBlocks = 0;
+  };
+
   thread_local static MemPool _instance;
+  static const int64_t _cSmallBytes[_cnSmallClasses];
+  // The small class for each multiple of the alignment up to |_cMaxSmallBytes|.
+  static const int8_t _cSmallClassOf[_cMaxSmallBytes / _cAlignment];
+  static CentralList _central[_cnClasses];
+  // The bytes held by the central tier, and the bytes currently allocated from the OS.
+  static std::atomic<int64_t> _nCentralBytes;
+  static std::atomic<int64_t> _nOsBytes;
+
+  void *_heads[_cnClasses];
+  int64_t _nCached[_cnClasses];
+
+  static int64_t classOf(const int64_t nBytes) {
+    if (nBytes <= _cMaxSmallBytes) {
+      return _cSmallClassOf[(nBytes - 1) / _cAlignment];
+    }
+    return _cnSmallClasses + (nBytes - 1) / _cPageSize;
+  }
+  static int64_t blockBytes(const int64_t iClass) {
+    if (iClass < _cnSmallClasses) {
+      return _cSmallBytes[iClass];
+    }
+    return (iClass - _cnSmallClasses + 1) * _cPageSize;
+  }
+  static int64_t cacheCap(const int64_t iClass) {
+    return std::max<int64_t>(_cMinCacheBlocks, _cCacheBytes / blockBytes(iClass));
+  }
+  static void* osAcquire(const int64_t nBytes);
+  static void osRelease(void *pMem, const int64_t nBytes);
 
-  void *_heads[_cMaxLenPages];
-  //TSync _syncs[_cMaxLenPages];
+  // Returns |nullptr| if the central tier has no blocks of the class.
+  void* refill(const int64_t iClass);
+  // Moves |nBlocks| blocks of the class from the cache to the central tier.
+  void spill(const int64_t iClass, const int64_t nBlocks);
+  // Carves a new slab into the blocks of a small class, and returns one of them.
+  void* carve(const int64_t iClass);
 
 public:
   MemPool() {
     memset(_heads, 0, sizeof(_heads));
+    memset(_nCached, 0, sizeof(_nCached));
   }
-  ~MemPool() {
-    for (int64_t i = 0; i < _cMaxLenPages; i++) {
-      void *cur = _heads[i];
-      while (cur != nullptr) {
-        void *next = *reinterpret_cast<void**>(cur);
-        _mm_free(cur);
-        cur = next;
-      }
-    }
-  }
+  ~MemPool();
 
   static MemPool& Instance() { return _instance; }
-  static int64_t RoundUp(const int64_t nBytes) { return ((nBytes - 1) / _cPageSize + 1) * _cPageSize; }
+  // The block size for |nBytes|, i.e. the capacity a vector can use for free.
+  static int64_t RoundUp(const int64_t nBytes) { return blockBytes(classOf(nBytes)); }
+  static int64_t CentralBytes() { return _nCentralBytes.load(std::memory_order_relaxed); }
+  static int64_t OsBytes() { return _nOsBytes.load(std::memory_order_relaxed); }
 
   void *Acquire(const int64_t nBytes) {
     if (nBytes <= 0) {
       return nullptr;
     }
-    const int64_t iSize = (nBytes-1) / _cPageSize;
-    if (iSize >= _cMaxLenPages) {
-      void *ans = _mm_malloc((iSize + 1)*_cPageSize, _cAlignment);
-      if (ans == nullptr) {
-        __debugbreak();
-      }
-      return ans;
+    const int64_t iClass = classOf(nBytes);
+    if (iClass >= _cnClasses) {
+      return osAcquire(blockBytes(iClass));
     }
-    
-    //SyncLock<TSync> sl(_syncs[iSize]);
-    void *ans = _heads[iSize];
+    void *ans = _heads[iClass];
     if (ans == nullptr) {
-      //sl.EarlyRelease();
-      ans = _mm_malloc((iSize + 1)*_cPageSize, _cAlignment);
+      ans = refill(iClass);
       if (ans == nullptr) {
-        __debugbreak();
+        Stats::Local().Add(WorkerStats::cPoolMisses, 1);
+        if (iClass < _cnSmallClasses) {
+          return carve(iClass);
+        }
+        return osAcquire(blockBytes(iClass));
       }
-      return ans;
     }
-    _heads[iSize] = *reinterpret_cast<void**>(ans);
+    _heads[iClass] = *reinterpret_cast<void**>(ans);
+    _nCached[iClass]--;
+    Stats::Local().Add(WorkerStats::cPoolHits, 1);
     return ans;
   }
 
@@ -66,14 +123,19 @@ public:
       }
       return;
     }
-    const int64_t iSize = (nBytes - 1) / _cPageSize;
-    if (iSize >= _cMaxLenPages) {
-      _mm_free(pMem);
+    const int64_t iClass = classOf(nBytes);
+    if (iClass >= _cnClasses) {
+      osRelease(pMem, blockBytes(iClass));
       return;
     }
 
-    //SyncLock<TSync> sl(_syncs[iSize]);
-    *reinterpret_cast<void**>(pMem) = _heads[iSize];
-    _heads[iSize] = pMem;
+    *reinterpret_cast<void**>(pMem) = _heads[iClass];
+    _heads[iClass] = pMem;
+    _nCached[iClass]++;
+    const int64_t cap = cacheCap(iClass);
+    if (_nCached[iClass] > cap) {
+      // Keep half of the cap, so that alternating acquires and releases don't spill each time.
+      spill(iClass, _nCached[iClass] - cap / 2);
+    }
   }
 };
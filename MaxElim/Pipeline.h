@@ -1,49 +1,327 @@
 #pragma once
 
+#include "SpinLock.h"
+#include "Stats.h"
+#include "SpillFile.h"
+
+// Work-stealing frontier: each worker owns a shard with its own best-first queue, and steals the best item of
+//   another shard only when its own shard is empty.
+// With a memory budget, a worker pushing beyond it spills the worst half of its shard to a scratch file, and the
+//   spilled items are read back best first once the queued items in memory drop below half the budget, or when
+//   there is nothing else to pop.
 template <typename T> class Pipeline {
   struct ProbCmp {
-    bool operator()(const Problem& a, const Problem& b) {
-      return a._cl3.size() > b._cl3.size();
+    bool operator()(const T& a, const T& b) {
+      return a.NonBinaryCount() > b.NonBinaryCount();
     }
   };
 
+  typedef SpinSync<1 << 5> TSync;
+
+  struct alignas(64) Shard {
+    TSync _sync;
+    // A heap by ProbCmp, rather than a std::priority_queue, so that the worst items can be taken out too.
+    std::vector<T> _heap;
+    // Lets the thieves skip empty shards without taking their locks.
+    std::atomic<int64_t> _nItems = 0;
+    // Whether the owner worker is processing an item it has popped. Only accessed by the owner.
+    bool _bHolding = false;
+  };
+
+  std::unique_ptr<Shard[]> _shards;
+  int64_t _nShards = 0;
+  // The number of items either queued or being processed. The pipeline is depleted when it drops to 0, because
+  //   then no worker can push any more items.
+  std::atomic<int64_t> _nOutstanding = 0;
+  std::atomic<int64_t> _nQueued = 0;
+  // The maximum of |_nQueued|, i.e. the high-water mark of the frontier.
+  std::atomic<int64_t> _nQueuedMax = 0;
+  std::atomic<int64_t> _nIdle = 0;
+  // Incremented when there is some other work for the idle workers.
+  std::atomic<int64_t> _nWakeups = 0;
+  std::atomic<bool> _bDepleted = false;
+  // Set when the search is cancelled, e.g. when another search has found the answer.
+  std::atomic<bool> _bStopped = false;
+  // Only idle workers sleep on these, so they are off the hot path.
   std::condition_variable _cvCanPop;
-  std::mutex _sync;
-  std::priority_queue<T, std::vector<T>, ProbCmp> _pq;
-  int64_t _nActive = 0;
+  std::mutex _idleSync;
+
+  //// Spilling to disk
+  // An item in the scratch file. |_memoryBytes| is its footprint when it was spilled.
+  struct Spilled {
+    int64_t _priority;
+    int64_t _offset;
+    int64_t _nBytes;
+    int64_t _memoryBytes;
+  };
+  struct SpilledCmp {
+    bool operator()(const Spilled &a, const Spilled &b) const {
+      return a._priority > b._priority;
+    }
+  };
+  // The budget of the memory footprint of the queued items, or 0 for no spilling.
+  int64_t _memoryBudget = 0;
+  std::atomic<int64_t> _queuedBytes = 0;
+  std::atomic<int64_t> _nSpilled = 0;
+  std::mutex _spillSync;
+  SpillFile _spillFile;
+  std::priority_queue<Spilled, std::vector<Spilled>, SpilledCmp> _spilled;
+
+  bool TryPopShard(Shard &shard, T &item) {
+    if (shard._nItems.load(std::memory_order_acquire) <= 0) {
+      return false;
+    }
+    SyncLock<TSync> sl(shard._sync);
+    if (shard._heap.empty()) {
+      return false;
+    }
+    std::pop_heap(shard._heap.begin(), shard._heap.end(), ProbCmp());
+    item = std::move(shard._heap.back());
+    shard._heap.pop_back();
+    shard._nItems.fetch_sub(1, std::memory_order_release);
+    _nQueued.fetch_sub(1);
+    _queuedBytes.fetch_sub(item.MemoryBytes(), std::memory_order_relaxed);
+    return true;
+  }
+
+  void pushShard(Shard &shard, std::vector<T> &items) {
+    int64_t nBytes = 0;
+    SyncLock<TSync> sl(shard._sync);
+    for (size_t i = 0; i < items.size(); i++) {
+      nBytes += items[i].MemoryBytes();
+      shard._heap.push_back(std::move(items[i]));
+      std::push_heap(shard._heap.begin(), shard._heap.end(), ProbCmp());
+    }
+    shard._nItems.fetch_add(int64_t(items.size()), std::memory_order_release);
+    _queuedBytes.fetch_add(nBytes, std::memory_order_relaxed);
+  }
+
+  // Moves the worst half of the shard to the scratch file. The items don't count as queued while they are in
+  //   neither, so that the idle workers wait for them instead of spinning.
+  void spill(Shard &shard) {
+    if (_spillFile.Failed()) {
+      return;
+    }
+    std::vector<T> victims;
+    {
+      SyncLock<TSync> sl(shard._sync);
+      const int64_t nVictims = int64_t(shard._heap.size()) / 2;
+      if (nVictims == 0) {
+        return;
+      }
+      // The worst items come first in the order of ProbCmp.
+      std::nth_element(shard._heap.begin(), shard._heap.begin() + nVictims, shard._heap.end(), ProbCmp());
+      victims.assign(std::make_move_iterator(shard._heap.begin()),
+        std::make_move_iterator(shard._heap.begin() + nVictims));
+      shard._heap.erase(shard._heap.begin(), shard._heap.begin() + nVictims);
+      std::make_heap(shard._heap.begin(), shard._heap.end(), ProbCmp());
+      shard._nItems.fetch_sub(nVictims, std::memory_order_release);
+      _nQueued.fetch_sub(nVictims);
+    }
+    WorkerStats &ws = Stats::Local();
+    std::vector<uint8_t> record;
+    size_t nDone = 0;
+    for (; nDone < victims.size(); nDone++) {
+      record.clear();
+      victims[nDone].Store(record);
+      std::unique_lock<std::mutex> lock(_spillSync);
+      const int64_t offset = _spillFile.Append(record);
+      if (offset < 0) {
+        break;
+      }
+      const int64_t memoryBytes = victims[nDone].MemoryBytes();
+      _spilled.push({ victims[nDone].NonBinaryCount(), offset, int64_t(record.size()), memoryBytes });
+      _nSpilled.fetch_add(1);
+      _nQueued.fetch_add(1);
+      _queuedBytes.fetch_sub(memoryBytes, std::memory_order_relaxed);
+      ws.Add(WorkerStats::cFrontierSpilled, 1);
+      ws.Add(WorkerStats::cFrontierSpillBytes, int64_t(record.size()));
+    }
+    victims.erase(victims.begin(), victims.begin() + nDone);
+    if (!victims.empty()) {
+      // The file has failed: keep the rest in memory.
+      for (size_t i = 0; i < victims.size(); i++) {
+        _queuedBytes.fetch_sub(victims[i].MemoryBytes(), std::memory_order_relaxed);
+      }
+      _nQueued.fetch_add(int64_t(victims.size()));
+      pushShard(shard, victims);
+    }
+  }
+
+  // Reads the best spilled items back into the shard, up to half the budget, but at least one. As in spill(), the
+  //   items don't count as queued while they are being rebuilt.
+  // Returns |false| if there were none.
+  bool unspill(Shard &shard) {
+    if (_nSpilled.load() <= 0) {
+      return false;
+    }
+    std::vector<std::vector<uint8_t>> records;
+    {
+      std::unique_lock<std::mutex> lock(_spillSync);
+      int64_t nBytes = _queuedBytes.load(std::memory_order_relaxed);
+      while (!_spilled.empty() && (records.empty() || nBytes < _memoryBudget / 2)) {
+        const Spilled top = _spilled.top();
+        _spilled.pop();
+        records.emplace_back();
+        _spillFile.Read(top._offset, top._nBytes, records.back());
+        _spillFile.Release(top._offset, top._nBytes);
+        nBytes += top._memoryBytes;
+      }
+      _nQueued.fetch_sub(int64_t(records.size()));
+    }
+    if (records.empty()) {
+      return false;
+    }
+    //// Rebuild the items outside the lock
+    std::vector<T> items(records.size());
+    for (size_t i = 0; i < records.size(); i++) {
+      items[i].Load(records[i].data());
+    }
+    _nQueued.fetch_add(int64_t(records.size()));
+    pushShard(shard, items);
+    _nSpilled.fetch_sub(int64_t(records.size()));
+    if (_nIdle.load() > 0) {
+      Wake(true);
+    }
+    Stats::Local().Add(WorkerStats::cFrontierUnspilled, int64_t(records.size()));
+    return true;
+  }
+
+  void Wake(const bool all) {
+    {
+      // Taking the lock ensures an idle worker is either before its predicate check or already waiting.
+      std::unique_lock<std::mutex> lock(_idleSync);
+    }
+    if (all) {
+      _cvCanPop.notify_all();
+    }
+    else {
+      _cvCanPop.notify_one();
+    }
+  }
 
 public:
   void SetWorkerCount(const int64_t nWorkers) {
-    _nActive = nWorkers;
+    _nShards = nWorkers;
+    _shards.reset(new Shard[nWorkers]);
+  }
+
+  // Spill to a scratch file in |spillDir| while the queued items in memory take more than |nBytes|, counting
+  //   T::MemoryBytes() of each. 0 means no limit.
+  void SetMemoryBudget(const int64_t nBytes, const std::string &spillDir) {
+    _memoryBudget = nBytes;
+    _spillFile.SetDir(spillDir);
   }
 
-  void Push(const T& item)
+  void Push(const int64_t iWorker, const T& item)
   {
+    _nOutstanding.fetch_add(1);
+    Shard &shard = _shards[iWorker];
     {
-      std::unique_lock<std::mutex> lock(_sync);
-      _pq.push(item);
+      SyncLock<TSync> sl(shard._sync);
+      shard._heap.push_back(item);
+      std::push_heap(shard._heap.begin(), shard._heap.end(), ProbCmp());
+      shard._nItems.fetch_add(1, std::memory_order_release);
+    }
+    const int64_t nQueued = _nQueued.fetch_add(1) + 1;
+    int64_t nQueuedMax = _nQueuedMax.load(std::memory_order_relaxed);
+    while (nQueued > nQueuedMax && !_nQueuedMax.compare_exchange_weak(nQueuedMax, nQueued)) {
+    }
+    const int64_t queuedBytes = _queuedBytes.fetch_add(item.MemoryBytes(), std::memory_order_relaxed);
+    if (_memoryBudget > 0 && queuedBytes > _memoryBudget) {
+      spill(shard);
+    }
+    if (_nIdle.load() > 0) {
+      Wake(false);
+    }
+  }
+
+  // Makes the workers' Pop() return |false|, leaving the items in the queues.
+  void Stop() {
+    _bStopped.store(true);
+    Wake(true);
+  }
+
+  // Returns |true| if all the items have been processed, rather than the search stopped.
+  bool Exhausted() const {
+    return _bDepleted.load();
+  }
+
+  // The number of the queued items.
+  int64_t Size() const {
+    return _nQueued.load(std::memory_order_relaxed);
+  }
+
+  int64_t HighWater() const {
+    return _nQueuedMax.load(std::memory_order_relaxed);
+  }
+
+  int64_t IdleCount() const {
+    return _nIdle.load(std::memory_order_relaxed);
+  }
+
+  // Wakes the idle workers to let them call their helper.
+  void WakeIdle() {
+    _nWakeups.fetch_add(1);
+    if (_nIdle.load() > 0) {
+      Wake(true);
     }
-    _cvCanPop.notify_one();
   }
 
-  bool Pop(T &item) {
-    std::unique_lock<std::mutex> lock(_sync);
+  // While there are no items to pop, calls helper.Help(), which should return |true| if it did some work.
+  template<typename THelper> bool Pop(const int64_t iWorker, T &item, THelper &helper) {
+    Shard &own = _shards[iWorker];
+    if (own._bHolding) {
+      own._bHolding = false;
+      if (_nOutstanding.fetch_sub(1) == 1) {
+        _bDepleted.store(true);
+        Wake(true);
+        return false; // Pipeline depleted
+      }
+    }
     for (;;) {
-      if (!_pq.empty()) {
+      if (_bStopped.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      if (_nSpilled.load(std::memory_order_relaxed) > 0
+        && _queuedBytes.load(std::memory_order_relaxed) < _memoryBudget / 2)
+      {
+        unspill(own);
+      }
+      if (TryPopShard(own, item)) {
         break;
       }
-      _nActive--;
-      if (_nActive <= 0) {
-        lock.unlock();
-        _cvCanPop.notify_all();
-        return false; // Pipeline depleted
+      bool bStolen = false;
+      for (int64_t i = 1; i < _nShards; i++) {
+        if (TryPopShard(_shards[(iWorker + i) % _nShards], item)) {
+          bStolen = true;
+          break;
+        }
+      }
+      if (bStolen) {
+        break;
+      }
+      if (unspill(own)) {
+        continue;
+      }
+      const int64_t nWakeups = _nWakeups.load();
+      if (helper.Help()) {
+        continue;
+      }
+      const auto tWaitStart = std::chrono::steady_clock::now();
+      std::unique_lock<std::mutex> lock(_idleSync);
+      _nIdle.fetch_add(1);
+      _cvCanPop.wait(lock, [&] {
+        return _nQueued.load() > 0 || _bDepleted.load() || _bStopped.load() || _nWakeups.load() != nWakeups;
+      });
+      _nIdle.fetch_sub(1);
+      Stats::Local().Add(WorkerStats::cWaitNs, std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - tWaitStart).count());
+      if (_bDepleted.load() || _bStopped.load()) {
+        return false; // Pipeline depleted or stopped
       }
-      _cvCanPop.wait(lock);
-      _nActive++;
     }
-    item = std::move(_pq.top());
-    _pq.pop();
+    own._bHolding = true;
     return true;
   }
 };
-
@@ -0,0 +1,551 @@
+#include "stdafx.h"
+#include "Preprocess.h"
+#include "Stats.h"
+
+bool Preprocessor::contains(const Clause &cl, const int64_t lit) {
+  for (int8_t j = 0; j < cl._size; j++) {
+    if (cl._lits[j] == lit) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Preprocessor::subsumes(const Clause &a, const int64_t skipA, const Clause &b, const int64_t skipB) {
+  for (int8_t i = 0; i < a._size; i++) {
+    if (a._lits[i] == skipA) {
+      continue;
+    }
+    if (a._lits[i] == skipB || !contains(b, a._lits[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int8_t Preprocessor::litValue(const int64_t lit) const {
+  const int8_t value = _value[abs(lit)];
+  return lit > 0 ? value : -value;
+}
+
+bool Preprocessor::addClause(const int64_t *pLits, const int64_t nLits) {
+  int64_t lits[3];
+  std::copy(pLits, pLits + nLits, lits);
+  std::sort(lits, lits + nLits);
+  int64_t n = 0;
+  for (int64_t i = 0; i < nLits; i++) {
+    const int64_t lit = lits[i];
+    const int8_t value = litValue(lit);
+    if (value == 1) {
+      return true; // satisfied
+    }
+    if (value == -1 || (n > 0 && lits[n - 1] == lit)) {
+      continue;
+    }
+    for (int64_t j = 0; j < n; j++) {
+      if (lits[j] == -lit) {
+        return true; // tautology
+      }
+    }
+    lits[n++] = lit;
+  }
+  switch (n) {
+  case 0:
+    _bUnsat = true;
+    return false;
+  case 1:
+    _units.push_back(lits[0]);
+    return true;
+  default:
+    break;
+  }
+  const int64_t iClause = int64_t(_clauses.size());
+  _clauses.emplace_back();
+  Clause &cl = _clauses.back();
+  std::copy(lits, lits + n, cl._lits);
+  cl._size = int8_t(n);
+  cl._bDeleted = false;
+  for (int64_t j = 0; j < n; j++) {
+    _occ[litIndex(lits[j])].push_back(iClause);
+  }
+  return true;
+}
+
+void Preprocessor::deleteClause(const int64_t iClause) {
+  _clauses[iClause]._bDeleted = true;
+}
+
+void Preprocessor::removeLiteral(Clause &cl, const int64_t lit) {
+  int8_t n = 0;
+  for (int8_t j = 0; j < cl._size; j++) {
+    if (cl._lits[j] != lit) {
+      cl._lits[n++] = cl._lits[j];
+    }
+  }
+  cl._size = n;
+}
+
+bool Preprocessor::propagate() {
+  while (!_units.empty()) {
+    const int64_t lit = _units.back();
+    _units.pop_back();
+    const int8_t value = litValue(lit);
+    if (value == 1) {
+      continue;
+    }
+    if (value == -1) {
+      _bUnsat = true;
+      return false;
+    }
+    _value[abs(lit)] = (lit > 0 ? 1 : -1);
+    _stack.push_back(Record{ rkUnit, 1, abs(lit), { lit, 0, 0 } });
+    const std::vector<int64_t> &satisfied = _occ[litIndex(lit)];
+    for (int64_t i = 0; i < int64_t(satisfied.size()); i++) {
+      deleteClause(satisfied[i]);
+    }
+    const std::vector<int64_t> &shortened = _occ[litIndex(-lit)];
+    for (int64_t i = 0; i < int64_t(shortened.size()); i++) {
+      Clause &cl = _clauses[shortened[i]];
+      if (cl._bDeleted || !contains(cl, -lit)) {
+        continue;
+      }
+      removeLiteral(cl, -lit);
+      if (cl._size == 1) {
+        _units.push_back(cl._lits[0]);
+        deleteClause(shortened[i]);
+      }
+    }
+  }
+  return true;
+}
+
+void Preprocessor::rebuildOccurrences() {
+  for (int64_t i = 0; i < int64_t(_occ.size()); i++) {
+    _occ[i].clear();
+  }
+  for (int64_t i = 0; i < int64_t(_clauses.size()); i++) {
+    const Clause &cl = _clauses[i];
+    if (cl._bDeleted) {
+      continue;
+    }
+    for (int8_t j = 0; j < cl._size; j++) {
+      _occ[litIndex(cl._lits[j])].push_back(i);
+    }
+  }
+}
+
+int64_t Preprocessor::substituteEquivalences() {
+  //// The implication graph of the 2-clauses in the CSR form: clause a|b gives the edges -a->b and -b->a
+  const int64_t nNodes = 2 * (_nVars + 1);
+  std::vector<int64_t> adjStart(nNodes + 1, 0);
+  for (const Clause &cl : _clauses) {
+    if (!cl._bDeleted && cl._size == 2) {
+      adjStart[litIndex(-cl._lits[0]) + 1]++;
+      adjStart[litIndex(-cl._lits[1]) + 1]++;
+    }
+  }
+  for (int64_t v = 0; v < nNodes; v++) {
+    adjStart[v + 1] += adjStart[v];
+  }
+  std::vector<int64_t> adj(adjStart[nNodes]);
+  std::vector<int64_t> iNext(adjStart.begin(), adjStart.end() - 1);
+  for (const Clause &cl : _clauses) {
+    if (!cl._bDeleted && cl._size == 2) {
+      adj[iNext[litIndex(-cl._lits[0])]++] = litIndex(cl._lits[1]);
+      adj[iNext[litIndex(-cl._lits[1])]++] = litIndex(cl._lits[0]);
+    }
+  }
+
+  //// Tarjan's algorithm with explicit stacks. The representative of a component is its node of the least frozen
+  ////   variable, or else of the least variable, so the complementary components get the complementary
+  ////   representatives.
+  std::vector<int64_t> index(nNodes, 0), low(nNodes, 0), comp(nNodes, -1), compRep;
+  std::vector<int64_t> sccStack, callStack;
+  int64_t counter = 0;
+  auto repKey = [this](const int64_t node) {
+    return std::make_pair(!_frozen[node >> 1], node >> 1);
+  };
+  auto visit = [&](const int64_t v) {
+    index[v] = low[v] = ++counter;
+    iNext[v] = adjStart[v];
+    sccStack.push_back(v);
+    callStack.push_back(v);
+  };
+  for (int64_t s = 0; s < nNodes; s++) {
+    if (index[s] != 0 || adjStart[s] == adjStart[s + 1]) {
+      continue;
+    }
+    visit(s);
+    while (!callStack.empty()) {
+      const int64_t v = callStack.back();
+      if (iNext[v] < adjStart[v + 1]) {
+        const int64_t w = adj[iNext[v]++];
+        if (index[w] == 0) {
+          visit(w);
+        }
+        else if (comp[w] == -1) {
+          low[v] = std::min(low[v], index[w]);
+        }
+        continue;
+      }
+      callStack.pop_back();
+      if (!callStack.empty()) {
+        low[callStack.back()] = std::min(low[callStack.back()], low[v]);
+      }
+      if (low[v] != index[v]) {
+        continue;
+      }
+      const int64_t iComp = int64_t(compRep.size());
+      compRep.push_back(v);
+      int64_t w;
+      do {
+        w = sccStack.back();
+        sccStack.pop_back();
+        comp[w] = iComp;
+        if (repKey(w) < repKey(compRep[iComp])) {
+          compRep[iComp] = w;
+        }
+      } while (w != v);
+    }
+  }
+  auto repOf = [&](const int64_t lit) {
+    if (_frozen[abs(lit)]) {
+      return lit;
+    }
+    const int64_t node = litIndex(lit);
+    const int64_t rep = (comp[node] == -1 ? node : compRep[comp[node]]);
+    return (rep & 1) ? -(rep >> 1) : (rep >> 1);
+  };
+
+  int64_t nSubstituted = 0;
+  for (int64_t v = 1; v <= _nVars; v++) {
+    if (_value[v] != 0 || _removed[v]) {
+      continue;
+    }
+    if (comp[litIndex(v)] != -1 && comp[litIndex(v)] == comp[litIndex(-v)]) {
+      _bUnsat = true;
+      return nSubstituted;
+    }
+    if (_frozen[v]) {
+      continue;
+    }
+    const int64_t rep = repOf(v);
+    if (rep != v) {
+      _removed[v] = true;
+      _stack.push_back(Record{ rkEquiv, 1, v, { rep, 0, 0 } });
+      nSubstituted++;
+    }
+  }
+  if (nSubstituted == 0) {
+    return 0;
+  }
+  Stats::Local().Add(WorkerStats::cPreSubstituted, nSubstituted);
+
+  //// Rewrite the clauses over the representatives
+  const int64_t nClauses = int64_t(_clauses.size());
+  for (int64_t i = 0; i < nClauses; i++) {
+    const Clause cl = _clauses[i];
+    if (cl._bDeleted) {
+      continue;
+    }
+    bool bAffected = false;
+    int64_t lits[3];
+    for (int8_t j = 0; j < cl._size; j++) {
+      lits[j] = repOf(cl._lits[j]);
+      bAffected |= (lits[j] != cl._lits[j]);
+    }
+    if (!bAffected) {
+      continue;
+    }
+    deleteClause(i);
+    if (!addClause(lits, cl._size)) {
+      return nSubstituted;
+    }
+  }
+  propagate();
+  return nSubstituted;
+}
+
+int64_t Preprocessor::subsume() {
+  // The shorter clauses first, as they subsume the longer ones.
+  std::vector<int64_t> order;
+  for (int64_t i = 0; i < int64_t(_clauses.size()); i++) {
+    if (!_clauses[i]._bDeleted) {
+      order.push_back(i);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [this](const int64_t a, const int64_t b) {
+    return _clauses[a]._size < _clauses[b]._size;
+  });
+
+  int64_t nSubsumed = 0, nStrengthened = 0;
+  for (const int64_t i : order) {
+    if (_clauses[i]._bDeleted) {
+      continue;
+    }
+    const Clause cl = _clauses[i];
+    //// Delete the clauses containing this one, scanning the shortest occurrence list of its literals
+    int64_t best = cl._lits[0];
+    for (int8_t j = 1; j < cl._size; j++) {
+      if (_occ[litIndex(cl._lits[j])].size() < _occ[litIndex(best)].size()) {
+        best = cl._lits[j];
+      }
+    }
+    const std::vector<int64_t> &candidates = _occ[litIndex(best)];
+    for (int64_t k = 0; k < int64_t(candidates.size()); k++) {
+      const int64_t iOther = candidates[k];
+      const Clause &other = _clauses[iOther];
+      if (iOther == i || other._bDeleted || other._size < cl._size || !subsumes(cl, 0, other, 0)) {
+        continue;
+      }
+      deleteClause(iOther);
+      nSubsumed++;
+    }
+    //// Self-subsuming resolution: if this clause with literal l flipped subsumes another, the other loses -l
+    for (int8_t j = 0; j < cl._size; j++) {
+      const int64_t lit = cl._lits[j];
+      const std::vector<int64_t> &others = _occ[litIndex(-lit)];
+      for (int64_t k = 0; k < int64_t(others.size()); k++) {
+        const int64_t iOther = others[k];
+        Clause &other = _clauses[iOther];
+        if (iOther == i || other._bDeleted || other._size < cl._size || !contains(other, -lit)
+          || !subsumes(cl, lit, other, -lit))
+        {
+          continue;
+        }
+        removeLiteral(other, -lit);
+        nStrengthened++;
+        if (other._size == 1) {
+          _units.push_back(other._lits[0]);
+          deleteClause(iOther);
+        }
+      }
+    }
+  }
+  Stats::Local().Add(WorkerStats::cPreSubsumed, nSubsumed);
+  Stats::Local().Add(WorkerStats::cPreStrengthened, nStrengthened);
+  propagate();
+  return nSubsumed + nStrengthened;
+}
+
+int64_t Preprocessor::eliminateVariables() {
+  rebuildOccurrences();
+  // The cheapest variables first.
+  std::vector<std::pair<int64_t, int64_t>> candidates;
+  for (int64_t v = 1; v <= _nVars; v++) {
+    if (_value[v] != 0 || _removed[v] || _frozen[v]) {
+      continue;
+    }
+    const int64_t nPos = int64_t(_occ[litIndex(v)].size());
+    const int64_t nNeg = int64_t(_occ[litIndex(-v)].size());
+    if (nPos + nNeg > 0 && nPos <= _cMaxElimOcc && nNeg <= _cMaxElimOcc) {
+      candidates.emplace_back(nPos * nNeg, v);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  int64_t nEliminated = 0;
+  std::vector<int64_t> pos, neg;
+  std::vector<Clause> resolvents;
+  for (const auto &candidate : candidates) {
+    const int64_t v = candidate.second;
+    if (_value[v] != 0) {
+      continue;
+    }
+    pos.clear();
+    neg.clear();
+    for (int8_t sign = 0; sign < 2; sign++) {
+      const int64_t lit = (sign == 0 ? v : -v);
+      std::vector<int64_t> &live = (sign == 0 ? pos : neg);
+      for (const int64_t iClause : _occ[litIndex(lit)]) {
+        if (!_clauses[iClause]._bDeleted && contains(_clauses[iClause], lit)) {
+          live.push_back(iClause);
+        }
+      }
+    }
+    if (pos.size() + neg.size() == 0 || int64_t(pos.size()) > _cMaxElimOcc || int64_t(neg.size()) > _cMaxElimOcc) {
+      continue;
+    }
+
+    //// The variable is eliminated only if its resolvents are 3-clauses at most and not more than its clauses
+    resolvents.clear();
+    bool bFits = true;
+    for (int64_t p = 0; p < int64_t(pos.size()) && bFits; p++) {
+      for (int64_t q = 0; q < int64_t(neg.size()); q++) {
+        const Clause &a = _clauses[pos[p]];
+        const Clause &b = _clauses[neg[q]];
+        Clause res;
+        res._size = 0;
+        res._bDeleted = false;
+        bool bTautology = false;
+        for (int8_t side = 0; side < 2 && !bTautology; side++) {
+          const Clause &from = (side == 0 ? a : b);
+          for (int8_t j = 0; j < from._size; j++) {
+            const int64_t lit = from._lits[j];
+            if (abs(lit) == v || contains(res, lit)) {
+              continue;
+            }
+            if (contains(res, -lit)) {
+              bTautology = true;
+              break;
+            }
+            if (res._size == 3) {
+              bFits = false;
+              break;
+            }
+            res._lits[res._size++] = lit;
+          }
+          if (!bFits) {
+            break;
+          }
+        }
+        if (!bFits) {
+          break;
+        }
+        if (bTautology) {
+          continue;
+        }
+        resolvents.push_back(res);
+        if (resolvents.size() > pos.size() + neg.size()) {
+          bFits = false;
+          break;
+        }
+      }
+    }
+    if (!bFits) {
+      continue;
+    }
+
+    //// Replace the clauses of the variable by the resolvents, keeping its positive clauses to reconstruct it
+    for (const int64_t iClause : pos) {
+      Record rec{ rkElimClause, 0, v, { 0, 0, 0 } };
+      const Clause &cl = _clauses[iClause];
+      for (int8_t j = 0; j < cl._size; j++) {
+        if (cl._lits[j] != v) {
+          rec._lits[rec._size++] = cl._lits[j];
+        }
+      }
+      _stack.push_back(rec);
+      deleteClause(iClause);
+    }
+    for (const int64_t iClause : neg) {
+      deleteClause(iClause);
+    }
+    _stack.push_back(Record{ rkElimVar, 0, v, { 0, 0, 0 } });
+    _removed[v] = true;
+    nEliminated++;
+    for (const Clause &res : resolvents) {
+      if (!addClause(res._lits, res._size)) {
+        return nEliminated;
+      }
+    }
+    if (!propagate()) {
+      return nEliminated;
+    }
+  }
+  Stats::Local().Add(WorkerStats::cPreEliminated, nEliminated);
+  return nEliminated;
+}
+
+template<typename TIdx> void Preprocessor::Load(const CowVector<Clause3<TIdx>> &clauses, const int64_t nVars) {
+  _nVars = nVars;
+  _occ.assign(2 * (nVars + 1), std::vector<int64_t>());
+  _value.assign(nVars + 1, 0);
+  _removed.assign(nVars + 1, false);
+  _frozen.assign(nVars + 1, false);
+  for (int64_t i = 0; i < clauses.size(); i++) {
+    int64_t lits[3];
+    int64_t n = 0;
+    for (int8_t j = 0; j < 3; j++) {
+      if (clauses[i]._vars[j] != 0) {
+        lits[n++] = clauses[i]._vars[j];
+      }
+    }
+    // An empty clause makes the problem unsatisfiable.
+    if (!addClause(lits, n)) {
+      return;
+    }
+  }
+}
+
+bool Preprocessor::Run() {
+  if (_bUnsat || !propagate()) {
+    return false;
+  }
+  for (int64_t round = 0; round < _cMaxRounds; round++) {
+    int64_t nChanges = substituteEquivalences();
+    if (_bUnsat) {
+      return false;
+    }
+    rebuildOccurrences();
+    nChanges += subsume();
+    if (_bUnsat) {
+      return false;
+    }
+    nChanges += eliminateVariables();
+    if (_bUnsat) {
+      return false;
+    }
+    if (nChanges == 0) {
+      break;
+    }
+  }
+  return true;
+}
+
+template<typename TIdx> void Preprocessor::Store(CowVector<Clause3<TIdx>> &clauses) const {
+  clauses.SetSize(0);
+  for (const Clause &cl : _clauses) {
+    if (cl._bDeleted) {
+      continue;
+    }
+    clauses.emplace_back();
+    Clause3<TIdx> &out = clauses.UnshadowedModifyBack();
+    for (int8_t j = 0; j < 3; j++) {
+      out._vars[j] = TIdx(j < cl._size ? cl._lits[j] : 0);
+    }
+  }
+  for (int64_t v = 1; v <= _nVars; v++) {
+    if (_frozen[v] && _value[v] != 0) {
+      clauses.emplace_back();
+      Clause3<TIdx> &out = clauses.UnshadowedModifyBack();
+      out._vars[0] = TIdx(_value[v] > 0 ? v : -v);
+      out._vars[1] = out._vars[2] = 0;
+    }
+  }
+}
+
+void Preprocessor::Reconstruct(CowBits &model) const {
+  auto isTrue = [&model](const int64_t lit) {
+    return model[abs(lit)] == (lit > 0);
+  };
+  for (int64_t i = int64_t(_stack.size()) - 1; i >= 0; i--) {
+    const Record &rec = _stack[i];
+    switch (rec._kind) {
+    case rkUnit:
+      model.Set(rec._var, rec._lits[0] > 0, nullptr);
+      break;
+    case rkEquiv:
+      model.Set(rec._var, isTrue(rec._lits[0]), nullptr);
+      break;
+    case rkElimVar:
+      model.Set(rec._var, false, nullptr);
+      break;
+    case rkElimClause: {
+      bool bSatisfied = false;
+      for (int8_t j = 0; j < rec._size; j++) {
+        bSatisfied |= isTrue(rec._lits[j]);
+      }
+      if (!bSatisfied) {
+        model.Set(rec._var, true, nullptr);
+      }
+      break;
+    }
+    }
+  }
+}
+
+template void Preprocessor::Load<int32_t>(const CowVector<Clause3<int32_t>> &clauses, const int64_t nVars);
+template void Preprocessor::Load<int64_t>(const CowVector<Clause3<int64_t>> &clauses, const int64_t nVars);
+template void Preprocessor::Store<int32_t>(CowVector<Clause3<int32_t>> &clauses) const;
+template void Preprocessor::Store<int64_t>(CowVector<Clause3<int64_t>> &clauses) const;
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "RawClause.h"
+#include "CowVector.h"
+
+// Simplifies the clauses before the search: propagates the 1-clauses, substitutes the equivalent literals found as
+//   the strongly-connected components of the implication graph of the 2-clauses, removes the subsumed clauses,
+//   strengthens clauses by self-subsuming resolution, and eliminates the variables whose resolvents stay within
+//   3-CNF without increasing the number of clauses. The removed variables are recorded on a stack, from which
+//   Reconstruct() extends a model of the simplified clauses to a model of the original ones.
+// The frozen variables, e.g. those of the clauses kept aside, are neither substituted nor eliminated, and their
+//   values found are stored as 1-clauses.
+class Preprocessor {
+  // Variables with more occurrences of a sign are not eliminated, to bound the cost of the resolution.
+  static const int64_t _cMaxElimOcc = 16;
+  static const int64_t _cMaxRounds = 4;
+
+  struct Clause {
+    // Sorted ascending.
+    int64_t _lits[3];
+    int8_t _size;
+    bool _bDeleted;
+  };
+
+  enum RecordKind : int8_t {
+    // The literal _lits[0] is true.
+    rkUnit,
+    // The variable equals the literal _lits[0].
+    rkEquiv,
+    // The variable is eliminated: false, unless one of the rkElimClause records under it requires it to be true.
+    rkElimVar,
+    // A clause of the eliminated variable in which it's positive, without the variable.
+    rkElimClause
+  };
+
+  struct Record {
+    RecordKind _kind;
+    int8_t _size;
+    int64_t _var;
+    int64_t _lits[3];
+  };
+
+  int64_t _nVars = 0;
+  bool _bUnsat = false;
+  std::vector<Clause> _clauses;
+  // The clauses of each literal, at index 2*var, plus 1 if negative. May list deleted clauses and clauses which
+  //   have lost the literal, so the users check.
+  std::vector<std::vector<int64_t>> _occ;
+  // For each variable: 1 if true, -1 if false, 0 if unknown.
+  std::vector<int8_t> _value;
+  // The variables substituted or eliminated, which don't occur in the clauses anymore.
+  std::vector<bool> _removed;
+  std::vector<bool> _frozen;
+  std::vector<int64_t> _units;
+  std::vector<Record> _stack;
+
+  static int64_t litIndex(const int64_t lit) { return 2 * abs(lit) + (lit < 0 ? 1 : 0); }
+  static bool contains(const Clause &cl, const int64_t lit);
+  // Whether the literals of |a| except |skipA| are all in |b| except |skipB|.
+  static bool subsumes(const Clause &a, const int64_t skipA, const Clause &b, const int64_t skipB);
+  int8_t litValue(const int64_t lit) const;
+
+  // Adds the clause simplified by the assignment. Returns |false| if the problem became unsatisfiable.
+  bool addClause(const int64_t *pLits, const int64_t nLits);
+  void deleteClause(const int64_t iClause);
+  void removeLiteral(Clause &cl, const int64_t lit);
+  bool propagate();
+  void rebuildOccurrences();
+  // Each of these returns the number of simplifications made.
+  int64_t substituteEquivalences();
+  int64_t subsume();
+  int64_t eliminateVariables();
+
+public:
+  template<typename TIdx> void Load(const CowVector<Clause3<TIdx>> &clauses, const int64_t nVars);
+
+  // Called after Load().
+  void Freeze(const int64_t var) { _frozen[var] = true; }
+
+  // Returns |false| if the problem is unsatisfiable.
+  bool Run();
+
+  // Replaces the clauses with the simplified ones, which are padded with zeros as the input clauses.
+  template<typename TIdx> void Store(CowVector<Clause3<TIdx>> &clauses) const;
+
+  // Sets the values of the removed variables in a model of the simplified clauses.
+  void Reconstruct(CowBits &model) const;
+};
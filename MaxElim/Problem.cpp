@@ -1,54 +1,135 @@
 #include "stdafx.h"
 #include "Problem.h"
 #include "ShadowProblem.h"
+#include "Solver2Sat.h"
+#include "Stats.h"
 
-FastVector<uint64_t>* Problem::AvlNodesShadow() const {
-  if (_pShadow == nullptr) return nullptr;
-  return &_pShadow->_avlNodes;
+namespace {
+  // The per-thread scratch of the model repair: a variable is flipped in the current repair iff its stamp equals
+  //   the epoch, so the stamps needn't be cleared between repairs.
+  struct FlipScratch {
+    FastVector<int64_t> _stamps;
+    int64_t _epoch = 0;
+    FastVector<int64_t> _stack;
+    FastVector<int64_t> _flipped;
+  };
+  thread_local FlipScratch tlFlipScratch;
 }
 
-template<int8_t taClauseSz> FastVector<uint64_t> *Problem::TreesShadow() const {
-  if (_pShadow == nullptr) return nullptr;
-  static_assert(taClauseSz == 2 || taClauseSz == 3, "We only support 2- and 3-clauses.");
+template<typename TIdx> template<int8_t taClauseSz> VarRefShadow *Problem<TIdx>::OccShadow() const {
+  if (_pShadow == nullptr || _pShadow->_bTrail) return nullptr;
+  static_assert(taClauseSz == 2 || taClauseSz == 3 || taClauseSz == cClauseSzLong,
+    "We only support 2-, 3- and long clauses.");
   if constexpr (taClauseSz == 2) {
-    return &_pShadow->_vr2trees;
+    return &_pShadow->_vr2;
+  }
+  else if constexpr (taClauseSz == 3) {
+    return &_pShadow->_vr3;
   }
   else {
-    return &_pShadow->_vr3trees;
+    return &_pShadow->_vrk;
   }
 }
 
-template FastVector<uint64_t> *Problem::TreesShadow<2>() const;
-template FastVector<uint64_t> *Problem::TreesShadow<3>() const;
+template VarRefShadow *Problem<int32_t>::OccShadow<2>() const;
+template VarRefShadow *Problem<int32_t>::OccShadow<3>() const;
+template VarRefShadow *Problem<int32_t>::OccShadow<cClauseSzLong>() const;
+template VarRefShadow *Problem<int64_t>::OccShadow<2>() const;
+template VarRefShadow *Problem<int64_t>::OccShadow<3>() const;
+template VarRefShadow *Problem<int64_t>::OccShadow<cClauseSzLong>() const;
 
-FastVector<uint64_t> *Problem::Cl3Shadow() const {
+template<typename TIdx> FastVector<uint64_t> *Problem<TIdx>::Cl3Shadow() const {
   if (_pShadow == nullptr) return nullptr;
   return &_pShadow->_cl3;
 }
 
-FastVector<uint64_t> *Problem::Cl2Shadow() const {
+template<typename TIdx> FastVector<uint64_t> *Problem<TIdx>::Cl2Shadow() const {
   if (_pShadow == nullptr) return nullptr;
   return &_pShadow->_cl2;
 }
 
-void Problem::RemoveClause3(const int64_t at) {
+template<typename TIdx> FastVector<uint64_t> *Problem<TIdx>::ClkShadow() const {
+  if (_pShadow == nullptr) return nullptr;
+  return &_pShadow->_clk;
+}
+
+template<typename TIdx> FastVector<uint64_t> *Problem<TIdx>::LitsKShadow() const {
+  if (_pShadow == nullptr) return nullptr;
+  return &_pShadow->_litsK;
+}
+
+template<typename TIdx> UndoTrail *Problem<TIdx>::Trail() const {
+  if (_pShadow == nullptr || !_pShadow->_bTrail) return nullptr;
+  return &_pShadow->_trail;
+}
+
+template<typename TIdx> void Problem<TIdx>::AddClause2(const int64_t a, const int64_t b) {
+  _cl2.emplace_back();
+  const int64_t iLast = _cl2.size() - 1;
+  Clause2<TIdx> &cl2mod = _cl2.Modify(iLast, Cl2Shadow(), Trail());
+  cl2mod._vars[0] = TIdx(a);
+  cl2mod._vars[1] = TIdx(b);
+  _vr2.Add(a, iLast, *this);
+  _vr2.Add(b, iLast, *this);
+  if (!Model2True(a) && !Model2True(b)) {
+    _pending2.emplace_back();
+    Clause2<TIdx> &pending = _pending2.Modify(_pending2.size() - 1, nullptr, Trail());
+    pending._vars[0] = TIdx(a);
+    pending._vars[1] = TIdx(b);
+  }
+}
+
+template<typename TIdx> void Problem<TIdx>::AddClause3(const int64_t a, const int64_t b, const int64_t c) {
+  _cl3.emplace_back();
+  const int64_t iLast = _cl3.size() - 1;
+  Clause3<TIdx> &cl3mod = _cl3.Modify(iLast, Cl3Shadow(), Trail());
+  cl3mod._vars[0] = TIdx(a);
+  cl3mod._vars[1] = TIdx(b);
+  cl3mod._vars[2] = TIdx(c);
+  _vr3.Add(a, iLast, *this);
+  _vr3.Add(b, iLast, *this);
+  _vr3.Add(c, iLast, *this);
+}
+
+template<typename TIdx> void Problem<TIdx>::AddClauseK(const int64_t *pLits, const int64_t nLits) {
+  const int64_t iFirst = _litsK.size();
+  for (int64_t j = 0; j < nLits; j++) {
+    _litsK.emplace_back();
+    _litsK.Modify(iFirst + j, LitsKShadow(), Trail()) = TIdx(pLits[j]);
+  }
+  _clk.emplace_back();
+  const int64_t iLast = _clk.size() - 1;
+  ClauseK<TIdx> &clkmod = _clk.Modify(iLast, ClkShadow(), Trail());
+  clkmod._iFirst = TIdx(iFirst);
+  clkmod._size = TIdx(nLits);
+  for (int64_t j = 0; j < nLits; j++) {
+    _vrk.Add(pLits[j], iLast, *this);
+  }
+}
+
+// The short input clauses are padded with zeros, which are not in the occurrence index.
+template<typename TIdx> void Problem<TIdx>::RemoveClause3(const int64_t at) {
   const int64_t iLast = _cl3.size() - 1;
   for (int8_t j = 0; j < 3; j++) {
-    _vr3.Del(_cl3[at]._vars[j], at, *this);
-    if (at != iLast) {
+    if (_cl3[at]._vars[j] != 0) {
+      _vr3.Del(_cl3[at]._vars[j], at, *this);
+    }
+    if (at != iLast && _cl3[iLast]._vars[j] != 0) {
       _vr3.Del(_cl3[iLast]._vars[j], iLast, *this);
     }
   }
   if (at != iLast) {
-    _cl3.Modify(at, Cl3Shadow()) = _cl3[iLast];
+    _cl3.Modify(at, Cl3Shadow(), Trail()) = _cl3[iLast];
     for (int8_t j = 0; j < 3; j++) {
-      _vr3.Add(_cl3[at]._vars[j], at, *this);
+      if (_cl3[at]._vars[j] != 0) {
+        _vr3.Add(_cl3[at]._vars[j], at, *this);
+      }
     }
   }
   _cl3.pop_back();
 }
 
-void Problem::RemoveClause2(const int64_t at) {
+template<typename TIdx> void Problem<TIdx>::RemoveClause2(const int64_t at) {
   const int64_t iLast = _cl2.size() - 1;
   for (int8_t j = 0; j < 2; j++) {
     _vr2.Del(_cl2[at]._vars[j], at, *this);
@@ -57,16 +138,103 @@ void Problem::RemoveClause2(const int64_t at) {
     }
   }
   if (at != iLast) {
-    _cl2.Modify(at, Cl2Shadow()) = _cl2.back();
+    _cl2.Modify(at, Cl2Shadow(), Trail()) = _cl2.back();
     for (int8_t j = 0; j < 2; j++) {
       _vr2.Add(_cl2[at]._vars[j], at, *this);
     }
   }
   _cl2.pop_back();
 }
+
+// The literals of the removed clause stay in the arena, as the arena only grows with the input clauses.
+template<typename TIdx> void Problem<TIdx>::RemoveClauseK(const int64_t at) {
+  const int64_t iLast = _clk.size() - 1;
+  for (int64_t j = 0; j < _clk[at]._size; j++) {
+    _vrk.Del(LitK(at, j), at, *this);
+  }
+  if (at != iLast) {
+    for (int64_t j = 0; j < _clk[iLast]._size; j++) {
+      _vrk.Del(LitK(iLast, j), iLast, *this);
+    }
+    _clk.Modify(at, ClkShadow(), Trail()) = _clk[iLast];
+    for (int64_t j = 0; j < _clk[at]._size; j++) {
+      _vrk.Add(LitK(at, j), at, *this);
+    }
+  }
+  _clk.pop_back();
+}
+
+template<typename TIdx> void Problem<TIdx>::ShortenClauseK(const int64_t at, const int64_t signedVar) {
+  const ClauseK<TIdx> cl = _clk[at];
+  if (cl._size == 4) {
+    int64_t rest[3];
+    int8_t n = 0;
+    for (int64_t j = 0; j < 4; j++) {
+      if (LitK(at, j) != signedVar) {
+        rest[n++] = LitK(at, j);
+      }
+    }
+    RemoveClauseK(at);
+    AddClause3(rest[0], rest[1], rest[2]);
+    return;
+  }
+  //// Move the last literal into the place of the removed one
+  int64_t j = 0;
+  while (LitK(at, j) != signedVar) {
+    j++;
+  }
+  const int64_t iLast = cl._size - 1;
+  const int64_t lastVar = LitK(at, iLast);
+  _vrk.Del(signedVar, at, *this);
+  if (j != iLast) {
+    _vrk.Del(lastVar, at, *this);
+    _litsK.Modify(cl._iFirst + j, LitsKShadow(), Trail()) = TIdx(lastVar);
+  }
+  _clk.Modify(at, ClkShadow(), Trail())._size--;
+  if (j != iLast) {
+    _vrk.Add(lastVar, at, *this);
+  }
+}
 // Returns |false| if the problem is unsatisfiable.
 // Returns |true| if the problem may be satisfiable.
-bool Problem::ApplyVar(const int64_t signedVar) {
+template<typename TIdx> bool Problem<TIdx>::ApplyVar(const int64_t signedVar) {
+  FastVector<int64_t> toApply;
+  FastVector<int64_t> toEss;
+  toApply.emplace_back();
+  toApply.UnshadowedModifyBack() = signedVar;
+  bool bMaybeSat = true;
+  int64_t nAssigned = 0;
+  for (; nAssigned < toApply.size(); nAssigned++) {
+    if (!AssignVar(toApply[nAssigned], toApply, toEss)) {
+      bMaybeSat = false;
+      break;
+    }
+  }
+  WorkerStats &ws = Stats::Local();
+  ws.Add(WorkerStats::cApplyVar, 1);
+  ws.Add(WorkerStats::cApplyAssigned, nAssigned);
+  ws.Max(WorkerStats::cApplyMaxChain, nAssigned);
+  if (!bMaybeSat) {
+    return false;
+  }
+  // Single-signed variables can only be eliminated once there are no pending unit clauses, because the latter
+  //   are not in the occurrence trees anymore.
+  for (int64_t i = 0; i < toEss.size(); i++) {
+    const int64_t var = toEss[i];
+    if (!ActSingleSigned(var)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Assigns the variable and simplifies the clauses it occurs in. Appends the resulting unit clauses to |toApply|
+//   and the variables of the satisfied clauses to |toEss|.
+// Returns |false| if the problem is unsatisfiable.
+// Returns |true| if the problem may be satisfiable.
+template<typename TIdx> bool Problem<TIdx>::AssignVar(const int64_t signedVar, FastVector<int64_t> &toApply,
+  FastVector<int64_t> &toEss)
+{
   const int64_t absVar = abs(signedVar);
   if (_varKnown[absVar]) {
     if (SignToBool(signedVar) != _varVal[absVar]) {
@@ -74,26 +242,38 @@ bool Problem::ApplyVar(const int64_t signedVar) {
     }
     return true; // nothing else to do
   }
-  _varKnown[absVar] = true;
-  _varVal[absVar] = SignToBool(signedVar);
+  _varKnown.Set(absVar, true, Trail());
+  _varVal.Set(absVar, SignToBool(signedVar), Trail());
   _nKnown++;
 
-  FastVector<int64_t> toEss;
-  FastVector<int64_t> clauses = _vr3.Clauses(signedVar, *this);
-  for (int64_t m = 0; m < clauses.size(); m++) {
-    const int64_t i = clauses[m];
+  // Each iteration removes the last occurrence of the literal, so the lists needn't be copied.
+  while (_vrk.Size(signedVar, *this) > 0) {
+    const int64_t i = _vrk.Occurrence(signedVar, _vrk.Size(signedVar, *this) - 1, *this);
+    // evaluates to |true|
+    for (int64_t k = 0; k < _clk[i]._size; k++) {
+      if (LitK(i, k) != signedVar) {
+        toEss.emplace_back();
+        toEss.UnshadowedModifyBack() = LitK(i, k);
+      }
+    }
+    RemoveClauseK(i);
+  }
+
+  while (_vrk.Size(-signedVar, *this) > 0) {
+    const int64_t i = _vrk.Occurrence(-signedVar, _vrk.Size(-signedVar, *this) - 1, *this);
+    ShortenClauseK(i, -signedVar);
+  }
+
+  while (_vr3.Size(signedVar, *this) > 0) {
+    const int64_t i = _vr3.Occurrence(signedVar, _vr3.Size(signedVar, *this) - 1, *this);
     int8_t j = 0;
     for (; j < 3; j++) {
       if (_cl3[i]._vars[j] == signedVar) {
         break;
       }
     }
-    //if (j >= 3) {
-    //  fprintf(stderr, "Inconsistency for var %lld at 3-clause %lld.\n", signedVar, i);
-    //  continue;
-    //}
     // evaluates to |true|
-    Clause3 cl = _cl3[i];
+    Clause3<TIdx> cl = _cl3[i];
     RemoveClause3(i);
     for (int8_t k = 0; k < 3; k++) {
       if (k == j) continue;
@@ -102,44 +282,28 @@ bool Problem::ApplyVar(const int64_t signedVar) {
     }
   }
 
-  clauses = _vr3.Clauses(-signedVar, *this);
-  for (int64_t m = 0; m < clauses.size(); m++) {
-    const int64_t i = clauses[m];
+  while (_vr3.Size(-signedVar, *this) > 0) {
+    const int64_t i = _vr3.Occurrence(-signedVar, _vr3.Size(-signedVar, *this) - 1, *this);
     int8_t j = 0;
     for (; j < 3; j++) {
       if (_cl3[i]._vars[j] == -signedVar) {
         break;
       }
     }
-    //if (j >= 3) {
-    //  fprintf(stderr, "Inconsistency for var %lld at 3-clause %lld.\n", -signedVar, i);
-    //  continue;
-    //}
     // Transform into 2-clause
-    int8_t at = 0;
-    _cl2.emplace_back();
-    Clause2 &cl2back = _cl2.ModifyBack(Cl2Shadow());
-    for (int8_t k = 0; k < 3; k++) {
-      if (k == j) continue;
-      _vr2.Add(cl2back._vars[at] = _cl3[i]._vars[k], _cl2.size() - 1, *this);
-      at++;
-    }
+    const Clause3<TIdx> cl = _cl3[i];
     RemoveClause3(i);
+    AddClause2(cl._vars[j == 0 ? 1 : 0], cl._vars[j == 2 ? 1 : 2]);
   }
 
-  clauses = _vr2.Clauses(signedVar, *this);
-  for (int64_t m = 0; m < clauses.size(); m++) {
-    const int64_t i = clauses[m];
+  while (_vr2.Size(signedVar, *this) > 0) {
+    const int64_t i = _vr2.Occurrence(signedVar, _vr2.Size(signedVar, *this) - 1, *this);
     int8_t j = 0;
     for (; j < 2; j++) {
       if (_cl2[i]._vars[j] == signedVar) {
         break;
       }
     }
-    //if (j >= 2) {
-    //  fprintf(stderr, "Inconsistency for var %lld at 2-clause %lld.\n", signedVar, i);
-    //  continue;
-    //}
     const int64_t signedOtherCl2 = _cl2[i]._vars[j ^ 1];
     RemoveClause2(i);
     // this clause just evaluates to true
@@ -147,46 +311,27 @@ bool Problem::ApplyVar(const int64_t signedVar) {
     toEss.UnshadowedModifyBack() = signedOtherCl2;
   }
 
-  clauses = _vr2.Clauses(-signedVar, *this);
-  FastVector<int64_t> toApply;
-  for (int64_t m = 0; m < clauses.size(); m++) {
-    const int64_t i = clauses[m];
+  while (_vr2.Size(-signedVar, *this) > 0) {
+    const int64_t i = _vr2.Occurrence(-signedVar, _vr2.Size(-signedVar, *this) - 1, *this);
     int8_t j = 0;
     for (; j < 2; j++) {
       if (_cl2[i]._vars[j] == -signedVar) {
         break;
       }
     }
-    //if (j >= 2) {
-    //  fprintf(stderr, "Inconsistency for var %lld at 2-clause %lld.\n", -signedVar, i);
-    //  continue;
-    //}
     const int64_t signedOtherCl2 = _cl2[i]._vars[j ^ 1];
     RemoveClause2(i);
     toApply.emplace_back();
     toApply.UnshadowedModifyBack() = signedOtherCl2;
   }
-
-  for (int64_t i = 0; i < toEss.size(); i++) {
-    const int64_t var = toEss[i];
-    if (!ActSingleSigned(var)) {
-      return false;
-    }
-  }
-  for (int64_t i = 0; i < toApply.size(); i++) {
-    const int64_t var = toApply[i];
-    if (!ApplyVar(var)) {
-      return false;
-    }
-  }
   return true;
 }
 
 // Returns |false| if the problem is unsatisfiable.
 // Returns |true| if the problem may be satisfiable.
-bool Problem::ActSingleSigned(const int64_t var) {
-  const bool straight = (_vr2.Size(var, *this) + _vr3.Size(var, *this)) > 0;
-  const bool inverse = (_vr2.Size(-var, *this) + _vr3.Size(-var, *this)) > 0;
+template<typename TIdx> bool Problem<TIdx>::ActSingleSigned(const int64_t var) {
+  const bool straight = (_vr2.Size(var, *this) + _vr3.Size(var, *this) + _vrk.Size(var, *this)) > 0;
+  const bool inverse = (_vr2.Size(-var, *this) + _vr3.Size(-var, *this) + _vrk.Size(-var, *this)) > 0;
   if (straight) {
     if (!inverse) {
       return ApplyVar(var);
@@ -202,7 +347,7 @@ bool Problem::ActSingleSigned(const int64_t var) {
 
 // Returns |false| if the problem is unsatisfiable.
 // Returns |true| if the problem may be satisfiable.
-bool Problem::EliminateSingleSigned() {
+template<typename TIdx> bool Problem<TIdx>::EliminateSingleSigned() {
   for (int64_t i = 1; i < int64_t(_varVal.size()); i++) {
     if (_varKnown[i]) {
       continue;
@@ -216,8 +361,8 @@ bool Problem::EliminateSingleSigned() {
 
 // Returns |false| if the problem is unsatisfiable.
 // Returns |true| if the problem may be satisfiable.
-bool Problem::NormalizeInput() {
-  std::vector<int64_t> toApply;
+template<typename TIdx> bool Problem<TIdx>::NormalizeInput() {
+  FastVector<int64_t> toApply;
   for (int64_t i = int64_t(_cl3.size()) - 1; ; i--) {
     while (i >= int64_t(_cl3.size())) {
       i--;
@@ -233,32 +378,30 @@ bool Problem::NormalizeInput() {
     }
     switch (j) {
     case -1: // empty clause
-      RemoveClause3(i);
-      break;
+      return false;
     case 0: { // 1-variable clause
       const int64_t signedVar = _cl3[i]._vars[0];
       RemoveClause3(i);
-      toApply.emplace_back(signedVar);
+      toApply.emplace_back();
+      toApply.UnshadowedModifyBack() = signedVar;
       break;
     }
     case 1: {// 2-variable clause
-      _cl2.emplace_back();
-      const int64_t iLast = _cl2.size() - 1;
-      Clause2 &cl2mod = _cl2.Modify(iLast, Cl2Shadow());
-      int64_t var = cl2mod._vars[0] = _cl3[i]._vars[0];
-      _vr2.Add(var, iLast, *this);
-      var = cl2mod._vars[1] = _cl3[i]._vars[1];
-      _vr2.Add(var, iLast, *this);
+      const Clause3<TIdx> cl = _cl3[i];
       RemoveClause3(i);
+      AddClause2(cl._vars[0], cl._vars[1]);
       break;
     }
     default: // 3-variable clause
       break;
     }
   }
-  // Now we've sorted into 1-clauses, 2-clauses and 3-clauses
-  for (int64_t i = 0; i < int64_t(toApply.size()); i++) {
-    if (!ApplyVar(toApply[i])) {
+  // Now we've sorted into 1-clauses, 2-clauses and 3-clauses. Propagate all the 1-clauses before eliminating the
+  //   single-signed variables, as ApplyVar() would do after each of them, because the pending 1-clauses are not in
+  //   the occurrence index: a variable may look single-signed while a pending 1-clause has the other sign.
+  FastVector<int64_t> toEss;
+  for (int64_t i = 0; i < toApply.size(); i++) {
+    if (!AssignVar(toApply[i], toApply, toEss)) {
       return false;
     }
   }
@@ -266,4 +409,270 @@ bool Problem::NormalizeInput() {
     return false;
   }
   return true;
-}
\ No newline at end of file
+}
+
+// Computes the model of the 2-clauses from scratch, e.g. at the root.
+// Returns |false| if the problem is unsatisfiable.
+// Returns |true| if the problem may be satisfiable.
+template<typename TIdx> bool Problem<TIdx>::InitModel2() {
+  Solver2Sat &s2s = Solver2Sat::ForThread();
+  if (!s2s.Run(*this)) {
+    return false;
+  }
+  for (int64_t i = 1; i < _model2.size(); i++) {
+    _model2.Set(i, s2s.Value(i), Trail());
+  }
+  _pending2.SetSize(0);
+  return true;
+}
+
+// Repairs the model for the pending 2-clauses, so that it becomes a model of all the 2-clauses.
+// Returns |false| if the 2-clauses are unsatisfiable.
+// Returns |true| if the model satisfies all the 2-clauses now.
+template<typename TIdx> bool Problem<TIdx>::Check2Sat() {
+  for (int64_t i = 0; i < _pending2.size(); i++) {
+    const Clause2<TIdx> cl = _pending2[i];
+    if (_varKnown[abs(cl._vars[0])] || _varKnown[abs(cl._vars[1])]) {
+      continue; // the clause has been removed by an assignment
+    }
+    if (Model2True(cl._vars[0]) || Model2True(cl._vars[1])) {
+      continue; // repaired along with another clause
+    }
+    // If both fail, each literal implies its negation.
+    if (!FlipClosure(cl._vars[0]) && !FlipClosure(cl._vars[1])) {
+      return false;
+    }
+  }
+  _pending2.SetSize(0);
+  return true;
+}
+
+// Makes the literal true in the model, along with all the literals it implies which are false in the model. The
+//   clauses satisfied before stay satisfied, because a literal made false implies the other literal of its clause.
+// Returns |false| and leaves the model intact if the literal implies its negation.
+// Returns |true| if the literal is true in the model now.
+template<typename TIdx> bool Problem<TIdx>::FlipClosure(const int64_t signedVar) {
+  FlipScratch &fs = tlFlipScratch;
+  if (fs._stamps.size() < _model2.size()) {
+    fs._stamps.AssignZeros(_model2.size());
+    fs._epoch = 0;
+  }
+  fs._epoch++;
+  fs._stack.SetSize(0);
+  fs._flipped.SetSize(0);
+
+  auto flip = [&](const int64_t lit) {
+    const int64_t absVar = abs(lit);
+    _model2.Set(absVar, SignToBool(lit), Trail());
+    fs._stamps.UnshadowedModify(absVar) = fs._epoch;
+    fs._stack.emplace_back();
+    fs._stack.UnshadowedModifyBack() = lit;
+    fs._flipped.emplace_back();
+    fs._flipped.UnshadowedModifyBack() = absVar;
+  };
+  flip(signedVar);
+  while (fs._stack.size() > 0) {
+    const int64_t lit = fs._stack.back();
+    fs._stack.SetSize(fs._stack.size() - 1);
+    // |lit| implies the other literal of each 2-clause with |-lit|.
+    const int64_t nOccs = _vr2.Size(-lit, *this);
+    for (int64_t m = 0; m < nOccs; m++) {
+      const Clause2<TIdx> &cl = _cl2[_vr2.Occurrence(-lit, m, *this)];
+      const int64_t other = cl._vars[cl._vars[0] == -lit ? 1 : 0];
+      if (Model2True(other)) {
+        continue;
+      }
+      if (fs._stamps[abs(other)] == fs._epoch) {
+        // The negation of |other| is implied too: roll the flips back.
+        for (int64_t k = 0; k < fs._flipped.size(); k++) {
+          const int64_t absVar = fs._flipped[k];
+          _model2.Set(absVar, !_model2[absVar], Trail());
+        }
+        return false;
+      }
+      flip(other);
+    }
+  }
+  return true;
+}
+
+// Assigns the unknown variables from the model of the 2-clauses, e.g. once no 3-clauses are left.
+template<typename TIdx> void Problem<TIdx>::ApplyModel2() {
+  for (int64_t i = 1; i < _varKnown.size(); i++) {
+    if (_varKnown[i]) {
+      continue;
+    }
+    _varKnown.Set(i, true, Trail());
+    _varVal.Set(i, _model2[i], Trail());
+    _nKnown++;
+  }
+}
+
+template<typename TIdx> ProblemDelta<TIdx> Problem<TIdx>::DeltaFrom(const Problem &root,
+  const ProblemDelta<TIdx> &parent, const Clause2<TIdx> &added) const
+{
+  ProblemDelta<TIdx> delta;
+  delta._nNonBinary = NonBinaryCount();
+  for (int64_t i = 1; i < _varKnown.size(); i++) {
+    if (_varKnown[i] && !root._varKnown[i]) {
+      delta._assigned.emplace_back();
+      delta._assigned.UnshadowedModifyBack() = TIdx(_varVal[i] ? i : -i);
+    }
+  }
+  // A 2-clause with a known variable is satisfied, as the other literal would have been propagated otherwise.
+  auto keep = [&](const Clause2<TIdx> &cl) {
+    if (cl._vars[0] == 0 || _varKnown[abs(cl._vars[0])] || _varKnown[abs(cl._vars[1])]) {
+      return;
+    }
+    delta._added.emplace_back();
+    delta._added.UnshadowedModifyBack() = cl;
+  };
+  for (int64_t i = 0; i < parent._added.size(); i++) {
+    keep(parent._added[i]);
+  }
+  keep(added);
+  return delta;
+}
+
+template<typename TIdx> void Problem<TIdx>::Rebuild(const Problem &root, const ProblemDelta<TIdx> &delta) {
+  _pShadow = nullptr;
+  _vrc = root._vrc;
+  _varVal = root._varVal;
+  _varKnown = root._varKnown;
+  _nKnown = root._nKnown;
+  for (int64_t i = 0; i < delta._assigned.size(); i++) {
+    const int64_t lit = delta._assigned[i];
+    _varKnown.Set(abs(lit), true, nullptr);
+    _varVal.Set(abs(lit), SignToBool(lit), nullptr);
+  }
+  _nKnown += delta._assigned.size();
+  _model2.Resize(_varVal.size());
+  _cl3 = CowVector<Clause3<TIdx>>();
+  _cl2 = CowVector<Clause2<TIdx>>();
+  _clk = CowVector<ClauseK<TIdx>>();
+  _litsK = CowVector<TIdx>();
+  _pending2 = CowVector<Clause2<TIdx>>();
+  _vr3.Init(*this);
+  _vr2.Init(*this);
+  _vrk.Init(*this);
+
+  for (int64_t i = 0; i < delta._added.size(); i++) {
+    AddClause2(delta._added[i]._vars[0], delta._added[i]._vars[1]);
+  }
+  // Whether an added 2-clause, which come first, subsumes the 3-clause: the left branch which added it has removed
+  //   the 3-clause.
+  auto subsumed = [&](const int64_t *pLits) {
+    for (int8_t j = 0; j < 3 && delta._added.size() > 0; j++) {
+      const int64_t a = pLits[j], b = pLits[j == 2 ? 0 : j + 1];
+      for (int64_t k = 0; k < _vr2.Size(a, *this); k++) {
+        const int64_t iClause = _vr2.Occurrence(a, k, *this);
+        const Clause2<TIdx> cl = _cl2[iClause];
+        if (iClause < delta._added.size() && (cl._vars[0] == b || cl._vars[1] == b)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+  std::vector<int64_t> lits;
+  // Adds the clause without its false literals, unless it's satisfied.
+  auto addReduced = [&](const int64_t *pLits, const int64_t nLits) {
+    lits.clear();
+    for (int64_t j = 0; j < nLits && pLits[j] != 0; j++) {
+      const int64_t absVar = abs(pLits[j]);
+      if (!_varKnown[absVar]) {
+        lits.push_back(pLits[j]);
+      }
+      else if (_varVal[absVar] == SignToBool(pLits[j])) {
+        return;
+      }
+    }
+    switch (lits.size()) {
+    case 0:
+    case 1:
+      // The propagation of the assignment would have failed or assigned the last literal.
+      fprintf(stderr, "The frontier delta leaves a clause of %lld literals.\n", int64_t(lits.size()));
+      __debugbreak();
+      break;
+    case 2:
+      AddClause2(lits[0], lits[1]);
+      break;
+    case 3:
+      if (!subsumed(lits.data())) {
+        AddClause3(lits[0], lits[1], lits[2]);
+      }
+      break;
+    default:
+      AddClauseK(lits.data(), int64_t(lits.size()));
+      break;
+    }
+  };
+  int64_t buf[3];
+  for (int64_t i = 0; i < root._cl3.size(); i++) {
+    for (int8_t j = 0; j < 3; j++) {
+      buf[j] = root._cl3[i]._vars[j];
+    }
+    addReduced(buf, 3);
+  }
+  for (int64_t i = 0; i < root._cl2.size(); i++) {
+    for (int8_t j = 0; j < 2; j++) {
+      buf[j] = root._cl2[i]._vars[j];
+    }
+    addReduced(buf, 2);
+  }
+  std::vector<int64_t> longLits;
+  for (int64_t i = 0; i < root._clk.size(); i++) {
+    longLits.resize(root._clk[i]._size);
+    for (int64_t j = 0; j < root._clk[i]._size; j++) {
+      longLits[j] = root.LitK(i, j);
+    }
+    addReduced(longLits.data(), int64_t(longLits.size()));
+  }
+  _vr3.Compact();
+  _vr2.Compact();
+  _vrk.Compact();
+  if (!InitModel2()) {
+    fprintf(stderr, "The 2-clauses of a frontier delta are unsatisfiable.\n");
+    __debugbreak();
+  }
+}
+
+template<typename TIdx> int64_t ProblemDelta<TIdx>::MemoryBytes() const {
+  return int64_t(sizeof(*this)) + _assigned.size() * int64_t(sizeof(TIdx))
+    + _added.size() * int64_t(sizeof(Clause2<TIdx>));
+}
+
+template<typename TIdx> void ProblemDelta<TIdx>::Store(std::vector<uint8_t> &out) const {
+  const int64_t header[] = { _nNonBinary, _assigned.size(), _added.size() };
+  out.insert(out.end(), reinterpret_cast<const uint8_t*>(header),
+    reinterpret_cast<const uint8_t*>(header) + sizeof(header));
+  const size_t at = out.size();
+  out.resize(at + _assigned.size() * sizeof(TIdx) + _added.size() * sizeof(Clause2<TIdx>));
+  if (_assigned.size() > 0) {
+    memcpy(&out[at], &_assigned[0], _assigned.size() * sizeof(TIdx));
+  }
+  if (_added.size() > 0) {
+    memcpy(&out[at + _assigned.size() * sizeof(TIdx)], &_added[0], _added.size() * sizeof(Clause2<TIdx>));
+  }
+}
+
+template<typename TIdx> void ProblemDelta<TIdx>::Load(const uint8_t *pData) {
+  int64_t header[3];
+  memcpy(header, pData, sizeof(header));
+  pData += sizeof(header);
+  _nNonBinary = header[0];
+  _assigned.AssignZeros(header[1], false);
+  if (header[1] > 0) {
+    memcpy(&_assigned.UnshadowedModify(0), pData, header[1] * sizeof(TIdx));
+  }
+  pData += header[1] * sizeof(TIdx);
+  _added.AssignZeros(header[2], false);
+  if (header[2] > 0) {
+    memcpy(&_added.UnshadowedModify(0), pData, header[2] * sizeof(Clause2<TIdx>));
+  }
+}
+
+template struct Problem<int32_t>;
+template struct Problem<int64_t>;
+template struct ProblemDelta<int32_t>;
+template struct ProblemDelta<int64_t>;
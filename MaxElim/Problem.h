@@ -2,34 +2,103 @@
 
 #include "RawClause.h"
 #include "VarRef.h"
+#include "UndoTrail.h"
 
-struct ShadowProblem;
+template<typename TIdx> struct ShadowProblem;
 
-struct Problem {
-  FastVector<Clause3> _cl3;
-  FastVector<Clause2> _cl2;
-  std::vector<bool> _varVal;
-  std::vector<bool> _varKnown;
+enum class SolveResult : int8_t {
+  Sat,
+  Unsat,
+  // The search was stopped before finding the answer.
+  Unknown
+};
+
+// A problem of the frontier as its difference from the root of the search: the literals assigned since the root,
+//   and the 2-clauses added by the left branches and not satisfied yet, see Problem::Rebuild(). The rest follows
+//   from the clauses of the root, so a delta takes a small fraction of the memory of the problem.
+template<typename TIdx> struct ProblemDelta {
+  FastVector<TIdx> _assigned;
+  FastVector<Clause2<TIdx>> _added;
+  int64_t _nNonBinary = 0;
+
+  int64_t NonBinaryCount() const { return _nNonBinary; }
+  int64_t MemoryBytes() const;
+  // Appends the delta to |out| as raw bytes.
+  void Store(std::vector<uint8_t> &out) const;
+  void Load(const uint8_t *pData);
+};
+
+// A node of the search. |TIdx| is the width of the literals and indices stored in the arrays.
+template<typename TIdx> struct Problem {
+  CowVector<Clause3<TIdx>> _cl3;
+  CowVector<Clause2<TIdx>> _cl2;
+  // The clauses of more than 3 literals, as ranges of the literal arena. A falsified literal is removed in place,
+  //   and the clause moves to |_cl3| once it's down to 3 literals.
+  CowVector<ClauseK<TIdx>> _clk;
+  CowVector<TIdx> _litsK;
+  CowBits _varVal;
+  CowBits _varKnown;
   int64_t _nKnown;
-  VarRef<3> _vr3;
-  VarRef<2> _vr2;
+  // A model of the 2-clauses over the unknown variables, except that it may violate the pending 2-clauses.
+  CowBits _model2;
+  // The 2-clauses added since the last Check2Sat() which the model violated when added.
+  CowVector<Clause2<TIdx>> _pending2;
+  VarRef<3, TIdx> _vr3;
+  VarRef<2, TIdx> _vr2;
+  VarRef<cClauseSzLong, TIdx> _vrk;
   VarRefCommon _vrc;
-  ShadowProblem *_pShadow = nullptr;
+  ShadowProblem<TIdx> *_pShadow = nullptr;
 
   static bool SignToBool(const int64_t var) {
     return var > 0;
   }
 
+  bool Model2True(const int64_t signedVar) const {
+    return _model2[abs(signedVar)] == SignToBool(signedVar);
+  }
+
+  int64_t LitK(const int64_t iClause, const int64_t j) const {
+    return _litsK[_clk[iClause]._iFirst + j];
+  }
+
+  // The clauses of 3 literals or more, which the lookahead minimizes.
+  int64_t NonBinaryCount() const {
+    return _cl3.size() + _clk.size();
+  }
+
+  void AddClause2(const int64_t a, const int64_t b);
+  void AddClause3(const int64_t a, const int64_t b, const int64_t c);
+  // Appends a clause of more than 3 literals to the arena, e.g. when the input is loaded.
+  void AddClauseK(const int64_t *pLits, const int64_t nLits);
   void RemoveClause3(const int64_t at);
   void RemoveClause2(const int64_t at);
+  void RemoveClauseK(const int64_t at);
+  // Removes the literal from the long clause, moving the clause to the 3-clauses if it gets 3 literals.
+  void ShortenClauseK(const int64_t at, const int64_t signedVar);
   bool ApplyVar(const int64_t signedVar);
+  bool AssignVar(const int64_t signedVar, FastVector<int64_t> &toApply, FastVector<int64_t> &toEss);
   bool ActSingleSigned(const int64_t var);
   bool EliminateSingleSigned();
   bool NormalizeInput();
+  bool InitModel2();
+  bool Check2Sat();
+  bool FlipClosure(const int64_t signedVar);
+  void ApplyModel2();
+
+  // Returns the difference of this problem from |root|, which it descends from. The 2-clauses added by the left
+  //   branches on the way are those of |parent|, the delta of the problem this one is derived from, and |added|
+  //   unless it's zeros.
+  ProblemDelta<TIdx> DeltaFrom(const Problem &root, const ProblemDelta<TIdx> &parent, const Clause2<TIdx> &added)
+    const;
+  // Replaces the problem with |root| plus |delta|: the clauses of the root not satisfied by the assignment, without
+  //   their false literals, and the added 2-clauses, with the occurrence indices and the model of the 2-clauses.
+  void Rebuild(const Problem &root, const ProblemDelta<TIdx> &delta);
 
-  FastVector<uint64_t> *AvlNodesShadow() const;
-  template<int8_t taClauseSz> FastVector<uint64_t> *TreesShadow() const;
+  template<int8_t taClauseSz> VarRefShadow *OccShadow() const;
   FastVector<uint64_t> *Cl3Shadow() const;
   FastVector<uint64_t> *Cl2Shadow() const;
+  FastVector<uint64_t> *ClkShadow() const;
+  FastVector<uint64_t> *LitsKShadow() const;
+  UndoTrail *Trail() const;
 };
 
@@ -1,10 +1,26 @@
 #pragma once
 
-struct Clause3 {
-  int64_t _vars[3];
+// The literals are signed variable numbers of type |TIdx|: int32_t if the problem fits, otherwise int64_t.
+template<typename TIdx> struct Clause3 {
+  TIdx _vars[3];
 };
 
-struct Clause2 {
-  int64_t _vars[2];
+template<typename TIdx> struct Clause2 {
+  TIdx _vars[2];
 };
 
+// A clause of more than 3 literals: a range of the literal arena, see Problem::_clk.
+template<typename TIdx> struct ClauseK {
+  TIdx _iFirst;
+  TIdx _size;
+};
+
+// The clause size parameter of the occurrence index of the clauses of more than 3 literals.
+const int8_t cClauseSzLong = 0;
+
+// Whether the literals, the clause indices and the occurrence slots of a problem fit in 32 bits. The occurrence
+//   arena may grow to several times the number of literal occurrences due to the relocations, hence the margin.
+inline bool FitsInt32(const int64_t nVars, const int64_t nClauses) {
+  const int64_t cLimit = int64_t(1) << 31;
+  return nVars < cLimit / 2 && nClauses < cLimit / 64;
+}
@@ -1,47 +1,87 @@
 #pragma once
 
 #include "RawClause.h"
-#include "FastVector.h"
+#include "CowVector.h"
 #include "Problem.h"
+#include "Stats.h"
 
-struct ShadowProblem {
+template<typename TIdx> struct ShadowProblem {
   FastVector<uint64_t> _cl3;
   FastVector<uint64_t> _cl2;
-  FastVector<uint64_t> _vr3trees;
-  FastVector<uint64_t> _vr2trees;
-  FastVector<uint64_t> _avlNodes;
+  FastVector<uint64_t> _clk;
+  FastVector<uint64_t> _litsK;
+  VarRefShadow _vr3;
+  VarRefShadow _vr2;
+  VarRefShadow _vrk;
+  // In the trail mode, the modifications are journaled instead of marked in the dirty bitmaps.
+  UndoTrail _trail;
+  bool _bTrail;
 
-  const Problem *_pOrig;
-  Problem *_pMod;
+  const Problem<TIdx> *_pOrig;
+  Problem<TIdx> *_pMod;
 
   int64_t CountUint64(const int64_t nBits) {
     return (nBits + 63) >> 6;
   }
 
-  ShadowProblem(const Problem& orig, Problem &mod) {
+  ShadowProblem(const Problem<TIdx>& orig, Problem<TIdx> &mod, const bool bTrail) {
     _pOrig = &orig;
     _pMod = &mod;
     _pMod->_pShadow = this;
+    _bTrail = bTrail;
+    if (_bTrail) {
+      return;
+    }
     _cl3.AssignZeros(CountUint64(orig._cl3.size()));
     _cl2.AssignZeros(CountUint64(orig._cl2.size()));
-    _vr3trees.AssignZeros(CountUint64(orig._vr3._trees.size()));
-    _vr2trees.AssignZeros(CountUint64(orig._vr2._trees.size()));
-    _avlNodes.AssignZeros(CountUint64(orig._vrc._avlNp._nodes.size()));
+    _clk.AssignZeros(CountUint64(orig._clk.size()));
+    _litsK.AssignZeros(CountUint64(orig._litsK.size()));
+    InitVarRef(_vr3, orig._vr3);
+    InitVarRef(_vr2, orig._vr2);
+    InitVarRef(_vrk, orig._vrk);
+  }
+
+  template<int8_t taClauseSz> void InitVarRef(VarRefShadow &shadow, const VarRef<taClauseSz, TIdx> &orig) {
+    shadow._lists.AssignZeros(CountUint64(orig._lists.size()));
+    shadow._slots.AssignZeros(CountUint64(orig._slots.size()));
+    shadow._back.AssignZeros(CountUint64(orig._back.size()));
   }
 
-  template<typename T> void RestoreArray(FastVector<uint64_t>& dirty, const FastVector<T>& orig,
-    FastVector<T> &mod)
+  // Returns the number of bytes copied.
+  template<int8_t taClauseSz> int64_t RestoreVarRef(VarRefShadow &shadow, const VarRef<taClauseSz, TIdx> &orig,
+    VarRef<taClauseSz, TIdx> &mod)
   {
+    return RestoreArray(shadow._lists, orig._lists, mod._lists) + RestoreArray(shadow._slots, orig._slots,
+      mod._slots) + RestoreArray(shadow._back, orig._back, mod._back);
+  }
+
+  // Returns the number of bytes copied.
+  template<typename T> int64_t RestoreArray(FastVector<uint64_t>& dirty, const CowVector<T>& orig,
+    CowVector<T> &mod)
+  {
+    int64_t nCopied = 0;
     //int64_t totBpc = 0; //DEBUG-PRINT
     mod.SetSize(orig.size());
     if (dirty.size() > 0) {
       for (int64_t i = 0; i < dirty.size(); i++) {
-        const uint64_t cur64 = dirty[i];
+        uint64_t cur64 = dirty[i];
         if (!cur64) {
           continue;
         }
-        const int64_t bpc = _mm_popcnt_u64(cur64);
+        if ((i << 6) >= orig.size()) {
+          break;
+        }
+        if (orig.size() - (i << 6) < 64) {
+          cur64 &= (uint64_t(1) << (orig.size() - (i << 6))) - 1; // the items past the end aren't restored
+        }
+        const int64_t bpc = std::popcount(cur64);
         //totBpc += bpc; //DEBUG-PRINT
+        if constexpr (Kernels::CanMask(sizeof(T))) {
+          // The pack doesn't cross a chunk boundary, so it's contiguous in both vectors.
+          Kernels::MaskedCopy(&mod.UnshadowedModify(i << 6), &orig[i << 6], cur64, sizeof(T));
+          nCopied += bpc;
+          continue;
+        }
         if (bpc <= 16) {
           //// Note: these are byte-order dependent (little endian)
           for (int8_t i32 = 0; i32 < 2; i32++) {
@@ -54,7 +94,7 @@ struct ShadowProblem {
               if (!cur16) {
                 continue;
               }
-              if (__popcnt16(cur16) <= 4) {
+              if (std::popcount(cur16) <= 4) {
                 for (int8_t i8 = 0; i8 < 2; i8++) {
                   const uint8_t cur8 = reinterpret_cast<const uint8_t*>(&cur16)[i8];
                   if (!cur8) {
@@ -69,6 +109,7 @@ struct ShadowProblem {
                       goto depleted; // no break level in C/C++
                     }
                     mod.UnshadowedModify(index) = orig[index];
+                    nCopied++;
                   }
                 }
               }
@@ -79,6 +120,7 @@ struct ShadowProblem {
                 }
                 const int64_t nItems = std::min<int64_t>(16, orig.size() - index);
                 Helper::AlignedCopy(&mod.UnshadowedModify(index), &orig[index], nItems * sizeof(T));
+                nCopied += nItems;
               }
             }
           }
@@ -90,28 +132,56 @@ struct ShadowProblem {
           }
           const int64_t nItems = std::min<int64_t>(64, orig.size() - index);
           Helper::AlignedCopy(&mod.UnshadowedModify(index), &orig[index], nItems * sizeof(T));
+          nCopied += nItems;
         }
       }
     depleted:
       memset(&dirty.UnshadowedModify(0), 0, dirty.size() * sizeof(uint64_t));
     }
     //printf(" %lld ", totBpc); //DEBUG-PRINT
+    return nCopied * sizeof(T);
   }
 
   void Restore() {
-    //// Restore arrays
-    RestoreArray(_cl3, _pOrig->_cl3, _pMod->_cl3);
-    RestoreArray(_cl2, _pOrig->_cl2, _pMod->_cl2);
-    RestoreArray(_vr3trees, _pOrig->_vr3._trees, _pMod->_vr3._trees);
-    RestoreArray(_vr2trees, _pOrig->_vr2._trees, _pMod->_vr2._trees);
-    RestoreArray(_avlNodes, _pOrig->_vrc._avlNp._nodes, _pMod->_vrc._avlNp._nodes);
-    //printf("\n"); // DEBUG-PRINT
+    int64_t nBytes = 0;
+    if (_bTrail) {
+      //// Restore sizes, then replay the journal
+      _pMod->_cl3.SetSize(_pOrig->_cl3.size());
+      _pMod->_cl2.SetSize(_pOrig->_cl2.size());
+      _pMod->_clk.SetSize(_pOrig->_clk.size());
+      _pMod->_litsK.SetSize(_pOrig->_litsK.size());
+      _pMod->_vr3._slots.SetSize(_pOrig->_vr3._slots.size());
+      _pMod->_vr3._back.SetSize(_pOrig->_vr3._back.size());
+      _pMod->_vr2._slots.SetSize(_pOrig->_vr2._slots.size());
+      _pMod->_vr2._back.SetSize(_pOrig->_vr2._back.size());
+      _pMod->_vrk._slots.SetSize(_pOrig->_vrk._slots.size());
+      _pMod->_vrk._back.SetSize(_pOrig->_vrk._back.size());
+      _pMod->_pending2.SetSize(_pOrig->_pending2.size());
+      nBytes = _trail._log.size() * sizeof(uint64_t);
+      _trail.Rollback();
+    }
+    else {
+      //// Restore arrays
+      nBytes += RestoreArray(_cl3, _pOrig->_cl3, _pMod->_cl3);
+      nBytes += RestoreArray(_cl2, _pOrig->_cl2, _pMod->_cl2);
+      nBytes += RestoreArray(_clk, _pOrig->_clk, _pMod->_clk);
+      nBytes += RestoreArray(_litsK, _pOrig->_litsK, _pMod->_litsK);
+      nBytes += RestoreVarRef(_vr3, _pOrig->_vr3, _pMod->_vr3);
+      nBytes += RestoreVarRef(_vr2, _pOrig->_vr2, _pMod->_vr2);
+      nBytes += RestoreVarRef(_vrk, _pOrig->_vrk, _pMod->_vrk);
+      //printf("\n"); // DEBUG-PRINT
+      _pMod->_varVal = _pOrig->_varVal;
+      _pMod->_varKnown = _pOrig->_varKnown;
+      _pMod->_model2 = _pOrig->_model2;
+      _pMod->_pending2 = _pOrig->_pending2;
+    }
 
     //// Restore scalars
-    _pMod->_vrc._avlNp._iSpare = _pOrig->_vrc._avlNp._iSpare;
-    _pMod->_varVal = _pOrig->_varVal;
-    _pMod->_varKnown = _pOrig->_varKnown;
     _pMod->_nKnown = _pOrig->_nKnown;
+
+    WorkerStats &ws = Stats::Local();
+    ws.Add(WorkerStats::cRestores, 1);
+    ws.Add(WorkerStats::cRestoreBytes, nBytes);
   }
 };
 
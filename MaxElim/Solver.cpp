@@ -0,0 +1,610 @@
+#include "stdafx.h"
+#include "Solver.h"
+#include "Cdcl.h"
+#include "Stats.h"
+
+namespace {
+  const bool gbSelfCheck = true;
+}
+
+template<typename TIdx> Solver<TIdx>::~Solver() {
+  {
+    std::unique_lock<std::mutex> lock(_mPool);
+    _bShutdown = true;
+  }
+  _cvStart.notify_all();
+  for (int64_t i = 0; i < int64_t(_threads.size()); i++) {
+    _threads[i].join();
+  }
+}
+
+template<typename TIdx> void Solver<TIdx>::reserveVars(const int64_t nVars) {
+  if (nVars <= _nVars) {
+    return;
+  }
+  _nVars = nVars;
+  _varUsed.resize(nVars + 1, false);
+  const int64_t oldCap = _initial._varVal.size() - 1;
+  if (nVars <= oldCap) {
+    return;
+  }
+  // Grow geometrically, so that adding the clauses one by one re-indexes them only a few times.
+  int64_t cap = std::max(nVars, 2 * oldCap);
+  if (!std::is_same<TIdx, int64_t>::value && !FitsInt32(cap, _initial._cl3.size() + _initial._litsK.size())) {
+    cap = nVars;
+  }
+  _initial._varKnown.Resize(cap + 1);
+  _initial._varVal.Resize(cap + 1);
+  _initial._model2.Resize(cap + 1);
+  _initial._nKnown = 0;
+  _initial._vrc.Init(cap);
+  _initial._vr3.Init(_initial);
+  _initial._vr2.Init(_initial);
+  _initial._vrk.Init(_initial);
+  for (int64_t i = 0; i < int64_t(_initial._cl3.size()); i++) {
+    indexClause(i);
+  }
+  for (int64_t i = 0; i < _initial._clk.size(); i++) {
+    indexClauseK(i);
+  }
+}
+
+template<typename TIdx> void Solver<TIdx>::markUsed(const int64_t var) {
+  if (!_varUsed[abs(var)]) {
+    _varUsed[abs(var)] = true;
+    _nUsedVars++;
+  }
+}
+
+template<typename TIdx> void Solver<TIdx>::indexClause(const int64_t iClause) {
+  for (int8_t j = 0; j < 3; j++) {
+    const int64_t var = _initial._cl3[iClause]._vars[j];
+    if (var == 0) {
+      break;
+    }
+    _initial._vr3.Add(var, iClause, _initial);
+    if (!_initial._vr3.Contains(var, iClause, _initial)) {
+      fprintf(stderr, "Failed to mark variable %lld in clause %lld\n", var, iClause);
+    }
+    markUsed(var);
+  }
+}
+
+template<typename TIdx> void Solver<TIdx>::indexClauseK(const int64_t iClause) {
+  for (int64_t j = 0; j < _initial._clk[iClause]._size; j++) {
+    const int64_t var = _initial.LitK(iClause, j);
+    _initial._vrk.Add(var, iClause, _initial);
+    markUsed(var);
+  }
+}
+
+template<typename TIdx> bool Solver<TIdx>::preprocess() {
+  _pPreprocessor.reset(new Preprocessor());
+  _pPreprocessor->Load(_root._cl3, _nVars);
+  // The long clauses pass through unchanged.
+  for (int64_t i = 0; i < _root._litsK.size(); i++) {
+    _pPreprocessor->Freeze(abs(_root._litsK[i]));
+  }
+  if (!_pPreprocessor->Run()) {
+    return false;
+  }
+  //// Index the simplified clauses over the same variable range as the root
+  const int64_t cap = _root._varVal.size() - 1;
+  _normalized = Problem<TIdx>();
+  _pPreprocessor->Store(_normalized._cl3);
+  _normalized._varKnown.Resize(cap + 1);
+  _normalized._varVal.Resize(cap + 1);
+  _normalized._model2.Resize(cap + 1);
+  _normalized._nKnown = 0;
+  _normalized._vrc.Init(cap);
+  _normalized._vr3.Init(_normalized);
+  std::vector<bool> used(cap + 1, false);
+  _nSearchUsedVars = 0;
+  for (int64_t i = 0; i < int64_t(_normalized._cl3.size()); i++) {
+    for (int8_t j = 0; j < 3; j++) {
+      const int64_t var = _normalized._cl3[i]._vars[j];
+      if (var == 0) {
+        break;
+      }
+      _normalized._vr3.Add(var, i, _normalized);
+      if (!used[abs(var)]) {
+        used[abs(var)] = true;
+        _nSearchUsedVars++;
+      }
+    }
+  }
+  _normalized._vr3.Compact();
+  _normalized._vr2.Init(_normalized);
+  _normalized._clk = _root._clk;
+  _normalized._litsK = _root._litsK;
+  _normalized._vrk.Init(_normalized);
+  for (int64_t i = 0; i < _normalized._clk.size(); i++) {
+    for (int64_t j = 0; j < _normalized._clk[i]._size; j++) {
+      const int64_t var = _normalized.LitK(i, j);
+      _normalized._vrk.Add(var, i, _normalized);
+      if (!used[abs(var)]) {
+        used[abs(var)] = true;
+        _nSearchUsedVars++;
+      }
+    }
+  }
+  return true;
+}
+
+template<typename TIdx> int Solver<TIdx>::Load(DimacsLoader &loader) {
+  CowVector<Clause3<TIdx>> clauses;
+  CowVector<ClauseK<TIdx>> longClauses;
+  CowVector<TIdx> longLits;
+  const int loadErr = loader.LoadClauses(clauses, longClauses, longLits, _nWorkers);
+  if (loadErr != 0) {
+    return loadErr;
+  }
+  _bEmptyClause |= loader._bEmptyClause;
+  if (!std::is_same<TIdx, int64_t>::value && !FitsInt32(std::max(loader._nVars, _nVars),
+    _initial._cl3.size() + clauses.size() + _initial._litsK.size() + longLits.size()))
+  {
+    return _cExitNeedsInt64;
+  }
+  reserveVars(loader._nVars);
+  const int64_t iFirst = _initial._cl3.size();
+  if (iFirst == 0) {
+    _initial._cl3 = std::move(clauses);
+  }
+  else {
+    for (int64_t i = 0; i < clauses.size(); i++) {
+      _initial._cl3.emplace_back();
+      _initial._cl3.UnshadowedModifyBack() = clauses[i];
+    }
+  }
+  for (int64_t i = iFirst; i < int64_t(_initial._cl3.size()); i++) {
+    indexClause(i);
+  }
+  if (iFirst == 0) {
+    _initial._vr3.Compact();
+  }
+
+  //// The same for the long clauses, whose literals are moved along the arena
+  const int64_t iFirstK = _initial._clk.size();
+  const int64_t iFirstLit = _initial._litsK.size();
+  if (iFirstK == 0 && iFirstLit == 0) {
+    _initial._clk = std::move(longClauses);
+    _initial._litsK = std::move(longLits);
+  }
+  else {
+    for (int64_t i = 0; i < longLits.size(); i++) {
+      _initial._litsK.emplace_back();
+      _initial._litsK.UnshadowedModifyBack() = longLits[i];
+    }
+    for (int64_t i = 0; i < longClauses.size(); i++) {
+      _initial._clk.emplace_back();
+      ClauseK<TIdx> &cl = _initial._clk.UnshadowedModifyBack();
+      cl = longClauses[i];
+      cl._iFirst = TIdx(cl._iFirst + iFirstLit);
+    }
+  }
+  for (int64_t i = iFirstK; i < _initial._clk.size(); i++) {
+    indexClauseK(i);
+  }
+  if (iFirstK == 0) {
+    _initial._vrk.Compact();
+  }
+  return 0;
+}
+
+template<typename TIdx> bool Solver<TIdx>::AddClause(const int64_t *pLits, const int64_t nLits) {
+  if (nLits < 1) {
+    return false;
+  }
+  //// Sort ascending, dropping the duplicates and the tautologies, as the loader does
+  std::vector<int64_t> lits(pLits, pLits + nLits);
+  std::sort(lits.begin(), lits.end());
+  int64_t n = 0;
+  int64_t maxVar = 0;
+  for (int64_t i = 0; i < nLits; i++) {
+    if (lits[i] == 0) {
+      return false;
+    }
+    if (n > 0 && lits[n - 1] == lits[i]) {
+      continue;
+    }
+    lits[n++] = lits[i];
+    maxVar = std::max(maxVar, abs(lits[i]));
+  }
+  for (int64_t j = 0; j < n; j++) {
+    if (lits[j] < 0 && std::binary_search(lits.begin(), lits.begin() + n, -lits[j])) {
+      return true; // always satisfied
+    }
+  }
+  if (!std::is_same<TIdx, int64_t>::value && !FitsInt32(std::max(maxVar, _nVars),
+    _initial._cl3.size() + 1 + _initial._litsK.size() + n))
+  {
+    return false;
+  }
+
+  reserveVars(maxVar);
+  if (n > 3) {
+    _initial.AddClauseK(lits.data(), n);
+    for (int64_t j = 0; j < n; j++) {
+      markUsed(lits[j]);
+    }
+    return true;
+  }
+  _initial._cl3.emplace_back();
+  Clause3<TIdx> &cl = _initial._cl3.UnshadowedModifyBack();
+  for (int8_t j = 0; j < 3; j++) {
+    cl._vars[j] = TIdx(j < n ? lits[j] : 0);
+  }
+  indexClause(_initial._cl3.size() - 1);
+  return true;
+}
+
+template<typename TIdx> void Solver<TIdx>::answer() {
+  _bAnswered.store(true);
+  for (int64_t i = 0; i < int64_t(_searches.size()); i++) {
+    _searches[i]->_problems.Stop();
+  }
+}
+
+template<typename TIdx> template<typename TModel> int64_t Solver<TIdx>::firstFailed(const Problem<TIdx> &prob,
+  const TModel &model)
+{
+  for (int64_t i = 0; i < int64_t(prob._cl3.size()); i++) {
+    bool satisfied = false;
+    for (int8_t j = 0; j < 3; j++) {
+      const int64_t signedVar = prob._cl3[i]._vars[j];
+      if (signedVar == 0) {
+        break;
+      }
+      if (model[abs(signedVar)] == Problem<TIdx>::SignToBool(signedVar)) {
+        satisfied = true;
+        break;
+      }
+    }
+    if (!satisfied) {
+      return i;
+    }
+  }
+  for (int64_t i = 0; i < prob._clk.size(); i++) {
+    bool satisfied = false;
+    for (int64_t j = 0; j < prob._clk[i]._size; j++) {
+      const int64_t signedVar = prob.LitK(i, j);
+      if (model[abs(signedVar)] == Problem<TIdx>::SignToBool(signedVar)) {
+        satisfied = true;
+        break;
+      }
+    }
+    if (!satisfied) {
+      return prob._cl3.size() + i;
+    }
+  }
+  return -1;
+}
+
+template<typename TIdx> void Solver<TIdx>::acceptModel(const Problem<TIdx> &cur) {
+  std::unique_lock<std::mutex> msl(_mSolution);
+  if (_bAnswered.load()) {
+    return; // another search has answered
+  }
+  //// Check against the input clauses and the assumptions
+  _model = cur._varVal;
+  if (_pPreprocessor != nullptr) {
+    _pPreprocessor->Reconstruct(_model);
+  }
+  _failedClause = firstFailed(_root, _model);
+  _bSolved = true;
+  answer();
+}
+
+template<typename TIdx> void Solver<TIdx>::worker(Search &search, const int64_t iWorker) {
+  ProblemDelta<TIdx> delta;
+  Problem<TIdx> cur;
+  while (search._problems.Pop(iWorker, delta, search._lookaheads)) {
+    Stats::Local().Add(WorkerStats::cNodes, 1);
+    cur.Rebuild(_normalized, delta);
+    if (gbSelfCheck) {
+      for (int64_t i = 0; i < int64_t(cur._cl3.size()); i++) {
+        for (int8_t j = 0; j < 3; j++) {
+          const int64_t var = cur._cl3[i]._vars[j];
+          if(!cur._vr3.Contains(var, i, cur)) {
+            fprintf(stderr, "Checking failed for variable %lld in 3-clause %lld.\n", var, i);
+          }
+        }
+      }
+      for (int64_t i = 0; i < int64_t(cur._cl2.size()); i++) {
+        for (int8_t j = 0; j < 2; j++) {
+          const int64_t var = cur._cl2[i]._vars[j];
+          if (!cur._vr2.Contains(var, i, cur)) {
+            fprintf(stderr, "Checking failed for variable %lld in 2-clause %lld.\n", var, i);
+          }
+        }
+      }
+      for (int64_t i = 0; i < cur._clk.size(); i++) {
+        for (int64_t j = 0; j < cur._clk[i]._size; j++) {
+          const int64_t var = cur.LitK(i, j);
+          if (!cur._vrk.Contains(var, i, cur)) {
+            fprintf(stderr, "Checking failed for variable %lld in long clause %lld.\n", var, i);
+          }
+        }
+      }
+    }
+
+    if (cur._nKnown == _nSearchUsedVars) { // Solution found
+      acceptModel(cur);
+      continue; // the pipeline is stopped now
+    }
+    if (cur.NonBinaryCount() == 0) { // reduced to 2-sat problem, which the model of the 2-clauses satisfies
+      cur.ApplyModel2();
+      acceptModel(cur);
+      continue; // the pipeline is stopped now
+    }
+
+    Lookahead<TIdx> la(cur, _bUndoTrail, search._heuristic, search._seed, &_bAnswered);
+    // Let the idle workers join the scan, e.g. near the root where the frontier is small.
+    const bool bShared = (search._problems.IdleCount() > 0);
+    if (bShared) {
+      search._lookaheads.Post(la);
+      search._problems.WakeIdle();
+    }
+    la.Run();
+    if (bShared) {
+      search._lookaheads.Withdraw(la);
+    }
+    if (!la.MaybeSat()) { // Unsatisfiable
+      continue;
+    }
+    if (la._maybeBestLeft && la.ApplyForced(la._bestLeft)) {
+      search._problems.Push(iWorker, la._bestLeft.DeltaFrom(_normalized, delta, la._bestLeftAdded));
+    }
+    if (la._maybeBestRight && la.ApplyForced(la._bestRight)) {
+      search._problems.Push(iWorker, la._bestRight.DeltaFrom(_normalized, delta, Clause2<TIdx>{}));
+    }
+  }
+  if (search._problems.Exhausted()) {
+    // The search is complete, so the problem is unsatisfiable unless some search has found a solution.
+    std::unique_lock<std::mutex> msl(_mSolution);
+    if (!_bAnswered.load()) {
+      answer();
+    }
+  }
+}
+
+template<typename TIdx> void Solver<TIdx>::cdclWorker() {
+  Cdcl cdcl;
+  cdcl.Load(_normalized);
+  const SolveResult result = cdcl.Solve(&_bAnswered);
+  if (result == SolveResult::Sat) {
+    Problem<TIdx> cur = _normalized;
+    for (int64_t i = 1; i < cur._varKnown.size(); i++) {
+      if (!cur._varKnown[i]) {
+        cur._varKnown.Set(i, true, cur.Trail());
+        cur._varVal.Set(i, cdcl.Value(i), cur.Trail());
+        cur._nKnown++;
+      }
+    }
+    acceptModel(cur);
+  }
+  else if (result == SolveResult::Unsat) {
+    std::unique_lock<std::mutex> msl(_mSolution);
+    if (!_bAnswered.load()) {
+      answer();
+    }
+  }
+}
+
+template<typename TIdx> void Solver<TIdx>::poolMain(const int64_t iThread) {
+  int64_t generation = 0;
+  for (;;) {
+    Search *pSearch;
+    int64_t iWorker;
+    {
+      std::unique_lock<std::mutex> lock(_mPool);
+      _cvStart.wait(lock, [&] { return _bShutdown || _generation != generation; });
+      if (_bShutdown) {
+        return;
+      }
+      generation = _generation;
+      if (iThread >= int64_t(_assignments.size())) {
+        continue; // not needed in this generation
+      }
+      pSearch = _assignments[iThread].first;
+      iWorker = _assignments[iThread].second;
+    }
+    if (pSearch->_bCdcl) {
+      cdclWorker();
+    }
+    else {
+      worker(*pSearch, iWorker);
+    }
+    std::unique_lock<std::mutex> lock(_mPool);
+    _nRunning--;
+    if (_nRunning == 0) {
+      _cvDone.notify_all();
+    }
+  }
+}
+
+template<typename TIdx> bool Solver<TIdx>::overBudget(const std::chrono::steady_clock::time_point deadline) const {
+  if (_bStopRequested.load()) {
+    return true;
+  }
+  if (_timeLimitSec > 0 && std::chrono::steady_clock::now() >= deadline) {
+    return true;
+  }
+  if (_memoryLimitBytes > 0 && MemPool::OsBytes() >= _memoryLimitBytes) {
+    return true;
+  }
+  if (_frontierLimit > 0) {
+    for (int64_t i = 0; i < int64_t(_searches.size()); i++) {
+      if (_searches[i]->_problems.Size() >= _frontierLimit) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+template<typename TIdx> void Solver<TIdx>::interrupt() {
+  std::unique_lock<std::mutex> msl(_mSolution);
+  if (_bAnswered.load()) {
+    return;
+  }
+  _bInterrupted = true;
+  answer();
+}
+
+template<typename TIdx> void Solver<TIdx>::runGeneration() {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<
+    std::chrono::steady_clock::duration>(std::chrono::duration<double>(_timeLimitSec));
+  std::unique_lock<std::mutex> lock(_mPool);
+  while (_threads.size() < _assignments.size()) {
+    _threads.emplace_back(&Solver::poolMain, this, int64_t(_threads.size()));
+  }
+  _nRunning = int64_t(_assignments.size());
+  _generation++;
+  _cvStart.notify_all();
+  while (!_cvDone.wait_for(lock, _cBudgetPollPeriod, [this] { return _nRunning == 0; })) {
+    if (overBudget(deadline)) {
+      lock.unlock();
+      interrupt();
+      lock.lock();
+    }
+  }
+}
+
+template<typename TIdx> bool Solver<TIdx>::prepare(const std::vector<int64_t> &assumptions) {
+  for (int64_t i = 0; i < int64_t(assumptions.size()); i++) {
+    reserveVars(abs(assumptions[i]));
+  }
+  _searches.clear();
+  _bAnswered.store(false);
+  _bSolved = false;
+  _bInterrupted = false;
+  _bStopRequested.store(false);
+  _failedClause = -1;
+  if (_bEmptyClause) {
+    return false;
+  }
+
+  //// Add the assumptions to a copy of the initial problem, which shares the unmodified chunks
+  _root = _initial;
+  _nSearchUsedVars = _nUsedVars;
+  std::set<int64_t> newlyUsed;
+  for (int64_t i = 0; i < int64_t(assumptions.size()); i++) {
+    const int64_t lit = assumptions[i];
+    if (lit == 0) {
+      continue;
+    }
+    _root._cl3.emplace_back();
+    Clause3<TIdx> &cl = _root._cl3.UnshadowedModifyBack();
+    cl._vars[0] = TIdx(lit);
+    cl._vars[1] = cl._vars[2] = 0;
+    _root._vr3.Add(lit, _root._cl3.size() - 1, _root);
+    if (!_varUsed[abs(lit)] && newlyUsed.insert(abs(lit)).second) {
+      _nSearchUsedVars++;
+    }
+  }
+
+  _pPreprocessor.reset();
+  if (_bPreprocess) {
+    if (!preprocess()) {
+      return false;
+    }
+  }
+  else {
+    _normalized = _root;
+  }
+  return _normalized.NormalizeInput() && _normalized.InitModel2();
+}
+
+template<typename TIdx> SolveResult Solver<TIdx>::Solve(const std::vector<int64_t> &assumptions) {
+  if (!prepare(assumptions)) {
+    return SolveResult::Unsat;
+  }
+
+  _assignments.clear();
+  if (_bCdcl) {
+    _searches.emplace_back(new Search());
+    _searches.back()->_bCdcl = true;
+    _assignments.emplace_back(_searches.back().get(), 0);
+    runGeneration();
+    return _bSolved ? SolveResult::Sat : (_bInterrupted ? SolveResult::Unknown : SolveResult::Unsat);
+  }
+
+  //// Split the workers between the searches, at least one each
+  const int64_t nSearches = int64_t(_heuristics.size());
+  for (int64_t s = 0; s < nSearches; s++) {
+    const int64_t nOwnWorkers = std::max<int64_t>(1, (_nWorkers + nSearches - 1 - s) / nSearches);
+    _searches.emplace_back(new Search());
+    Search &search = *_searches.back();
+    search._heuristic = _heuristics[s];
+    search._seed = uint64_t(s + 1);
+    search._problems.SetWorkerCount(nOwnWorkers);
+    search._problems.SetMemoryBudget(_frontierMemoryBytes / nSearches, _spillDir);
+    search._problems.Push(0, _normalized.DeltaFrom(_normalized, ProblemDelta<TIdx>(), Clause2<TIdx>{}));
+    for (int64_t i = 0; i < nOwnWorkers; i++) {
+      _assignments.emplace_back(&search, i);
+    }
+  }
+  runGeneration();
+  return _bSolved ? SolveResult::Sat : (_bInterrupted ? SolveResult::Unknown : SolveResult::Unsat);
+}
+
+template<typename TIdx> SolveResult Solver<TIdx>::MakeCubes(const int64_t depth, const int64_t minCubes,
+  std::vector<std::vector<int64_t>> &cubes)
+{
+  cubes.clear();
+  if (!prepare({})) {
+    return SolveResult::Unsat;
+  }
+  // A node of the expansion, with the branch literals leading to it.
+  struct Node {
+    Problem<TIdx> _prob;
+    std::vector<int64_t> _cube;
+  };
+  std::vector<Node> level(1);
+  level[0]._prob = _normalized;
+  for (int64_t d = 0; !level.empty(); d++) {
+    const bool bLast = (d == depth) || (minCubes > 0 && int64_t(level.size()) >= minCubes);
+    std::vector<Node> next;
+    for (size_t i = 0; i < level.size(); i++) {
+      Problem<TIdx> &cur = level[i]._prob;
+      if (cur._nKnown == _nSearchUsedVars || cur.NonBinaryCount() == 0) {
+        if (cur._nKnown != _nSearchUsedVars) {
+          cur.ApplyModel2(); // the model of the 2-clauses satisfies the rest, as in worker()
+        }
+        acceptModel(cur);
+        return SolveResult::Sat;
+      }
+      if (bLast) {
+        cubes.push_back(std::move(level[i]._cube));
+        continue;
+      }
+      Lookahead<TIdx> la(cur, _bUndoTrail, _heuristics[0], 1);
+      la.Run();
+      if (!la.MaybeSat()) {
+        continue;
+      }
+      // Branch on the variable rather than on the clause, so that the cubes are conjunctions of literals.
+      for (const int64_t lit : { la._bestLit, -la._bestLit }) {
+        Node child = { cur, level[i]._cube };
+        child._cube.push_back(lit);
+        if (child._prob.ApplyVar(lit) && la.ApplyForced(child._prob)) {
+          next.push_back(std::move(child));
+        }
+      }
+    }
+    level = std::move(next);
+  }
+  return cubes.empty() ? SolveResult::Unsat : SolveResult::Unknown;
+}
+
+template<typename TIdx> int64_t Solver<TIdx>::FrontierHighWater() const {
+  int64_t ans = 0;
+  for (int64_t i = 0; i < int64_t(_searches.size()); i++) {
+    ans = std::max(ans, _searches[i]->_problems.HighWater());
+  }
+  return ans;
+}
+
+template class Solver<int32_t>;
+template class Solver<int64_t>;
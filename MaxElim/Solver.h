@@ -0,0 +1,166 @@
+#pragma once
+
+#include "Problem.h"
+#include "Pipeline.h"
+#include "Lookahead.h"
+#include "DimacsLoader.h"
+#include "Preprocess.h"
+
+// An embeddable solver: the clauses are added incrementally, and Solve() may be called many times, each under its
+//   own assumptions. The worker threads with their memory pools, and the occurrence index of the clauses persist
+//   across the calls. |TIdx| is the width of the literals and indices, see FitsInt32().
+template<typename TIdx> class Solver {
+  // A search with its own frontier, run by a subset of the workers, or the CDCL engine run by one worker.
+  struct Search {
+    bool _bCdcl = false;
+    Heuristic _heuristic;
+    uint64_t _seed;
+    Pipeline<ProblemDelta<TIdx>> _problems;
+    LookaheadBoard<TIdx> _lookaheads;
+  };
+
+  // How often Solve() checks the budgets while the workers search.
+  static constexpr std::chrono::milliseconds _cBudgetPollPeriod = std::chrono::milliseconds(10);
+
+  const int64_t _nWorkers;
+  std::vector<Heuristic> _heuristics = { Heuristic::MinTotCl3 };
+  bool _bCdcl = false;
+  bool _bPreprocess = true;
+  // Roll the probes back with the undo trail instead of the dirty bitmaps.
+  bool _bUndoTrail = false;
+  // The budgets of each Solve(), or 0 for none.
+  double _timeLimitSec = 0;
+  int64_t _memoryLimitBytes = 0;
+  int64_t _frontierLimit = 0;
+  // The memory budget of the frontiers, beyond which they spill to a scratch file in |_spillDir|, or 0 for none.
+  int64_t _frontierMemoryBytes = 0;
+  std::string _spillDir;
+
+  // The clauses added so far, indexed, over the variables up to |_nVars|. The arrays may have spare capacity.
+  Problem<TIdx> _initial;
+  int64_t _nVars = 0;
+  std::vector<bool> _varUsed;
+  int64_t _nUsedVars = 0;
+  // Whether the loaded clauses include an empty one, so that every Solve() is Unsat.
+  bool _bEmptyClause = false;
+
+  //// The state of the current Solve()
+  // The initial problem with the assumptions added as 1-clauses.
+  Problem<TIdx> _root;
+  // The simplification of the root, if enabled, which reconstructs the removed variables of a model.
+  std::unique_ptr<Preprocessor> _pPreprocessor;
+  // The problem the searches start from, which the frontier problems are deltas from, and the count of the
+  //   variables in its clauses.
+  Problem<TIdx> _normalized;
+  int64_t _nSearchUsedVars = 0;
+  std::vector<std::unique_ptr<Search>> _searches;
+  std::mutex _mSolution;
+  // Set by the first search to find the answer, or when the search is interrupted, so that the searches stop at
+  //   their next node or lookahead block.
+  std::atomic<bool> _bAnswered = false;
+  bool _bSolved = false;
+  bool _bInterrupted = false;
+  std::atomic<bool> _bStopRequested = false;
+  CowBits _model;
+  int64_t _failedClause = -1;
+
+  //// The thread pool
+  std::vector<std::thread> _threads;
+  std::mutex _mPool;
+  // The threads wait for a new generation, and Solve() waits for them to finish it.
+  std::condition_variable _cvStart;
+  std::condition_variable _cvDone;
+  int64_t _generation = 0;
+  int64_t _nRunning = 0;
+  bool _bShutdown = false;
+  // The search of each thread in the current generation, and the worker index in it.
+  std::vector<std::pair<Search*, int64_t>> _assignments;
+
+  // Makes room for the variables up to |nVars|, re-indexing the clauses if the arrays have to grow.
+  void reserveVars(const int64_t nVars);
+  void indexClause(const int64_t iClause);
+  void indexClauseK(const int64_t iClause);
+  void markUsed(const int64_t var);
+  // Sets |_normalized| to the simplified root. Returns |false| if the root is unsatisfiable.
+  bool preprocess();
+  // Sets up |_normalized| for the search under the assumptions. Returns |false| if it's unsatisfiable.
+  bool prepare(const std::vector<int64_t> &assumptions);
+  void poolMain(const int64_t iThread);
+  void runGeneration();
+  void worker(Search &search, const int64_t iWorker);
+  void cdclWorker();
+  // Stops all the searches. Only called under |_mSolution|.
+  void answer();
+  void acceptModel(const Problem<TIdx> &cur);
+  // Returns the first clause of |prob| violated by |model|, numbered as by FailedClause(), or -1 if none.
+  template<typename TModel> static int64_t firstFailed(const Problem<TIdx> &prob, const TModel &model);
+  // Returns |true| if a stop has been requested or a budget is exceeded.
+  bool overBudget(const std::chrono::steady_clock::time_point deadline) const;
+  // Stops the searches without an answer, unless they have already found it.
+  void interrupt();
+
+public:
+  // Returned by Load() with 32-bit indices if the clauses need 64-bit ones.
+  static const int _cExitNeedsInt64 = 8;
+
+  explicit Solver(const int64_t nWorkers) : _nWorkers(nWorkers) { }
+  ~Solver();
+  Solver(const Solver&) = delete;
+  Solver& operator=(const Solver&) = delete;
+
+  // The heuristics of the portfolio: the workers are split between them, each running a complete search.
+  void SetHeuristics(const std::vector<Heuristic> &heuristics) { _heuristics = heuristics; }
+  // Solve with conflict-driven clause learning in one worker instead of the lookahead search.
+  void SetCdcl(const bool bCdcl) { _bCdcl = bCdcl; }
+  // Simplify the clauses and the assumptions before each search, see Preprocessor. Enabled by default.
+  void SetPreprocess(const bool bPreprocess) { _bPreprocess = bPreprocess; }
+  // Roll the probes of the lookahead back by replaying the undo trail of their modifications, or otherwise by
+  //   restoring the items marked in the dirty bitmaps, see ShadowProblem::Restore(). The bitmaps are the
+  //   default: they restore less memory than the trail, which logs 4 words of metadata per item.
+  void SetUndoTrail(const bool bUndoTrail) { _bUndoTrail = bUndoTrail; }
+  // Solve() returns Unknown once it has run for |seconds|, the memory pools hold |bytes| from the OS, or the
+  //   frontier of a search holds |nItems| problems. 0 means no limit.
+  void SetTimeLimit(const double seconds) { _timeLimitSec = seconds; }
+  void SetMemoryLimit(const int64_t bytes) { _memoryLimitBytes = bytes; }
+  void SetFrontierLimit(const int64_t nItems) { _frontierLimit = nItems; }
+  // Keeps the frontiers within |bytes| of memory, split between the searches, by spilling the worst problems to
+  //   scratch files in |dir|, or the current directory if empty. 0 means no limit.
+  void SetFrontierMemory(const int64_t bytes, const std::string &dir) {
+    _frontierMemoryBytes = bytes;
+    _spillDir = dir;
+  }
+  // Makes the Solve() in progress return Unknown shortly. May be called from any thread.
+  void RequestStop() { _bStopRequested.store(true); }
+
+  // Loads the clauses of the file opened by the loader, parsing with the workers count of threads.
+  // Returns 0 on success, |_cExitNeedsInt64|, otherwise the exit code for main() after printing the error.
+  int Load(DimacsLoader &loader);
+
+  // Adds a clause of 1 or more literals, which are signed variable numbers.
+  // Returns |false| if the clause is empty or has a 0 literal, or the clauses don't fit |TIdx|.
+  bool AddClause(const int64_t *pLits, const int64_t nLits);
+  bool AddClause(std::initializer_list<int64_t> lits) { return AddClause(lits.begin(), int64_t(lits.size())); }
+
+  // Solves the clauses added so far with the literals of |assumptions| forced true. Returns Unknown if a budget is
+  //   exceeded or a stop is requested, with the statistics counted until then.
+  SolveResult Solve(const std::vector<int64_t> &assumptions = {});
+
+  // Splits the problem into cubes by the lookahead, each branch assigning the variable of the best candidate either
+  //   way, and skipping the branches found unsatisfiable. The expansion goes breadth-first to |depth| branching
+  //   literals, or until there are at least |minCubes|, where a negative depth or 0 cubes means no limit. Returns Sat
+  //   if the expansion has found a model, Unsat if no cubes are left, otherwise Unknown with the cubes, which
+  //   together cover all the solutions, to solve with Solve(cube).
+  SolveResult MakeCubes(const int64_t depth, const int64_t minCubes, std::vector<std::vector<int64_t>> &cubes);
+
+  int64_t VarCount() const { return _nVars; }
+  // The value of the variable in the model found by the last Solve() returning Sat.
+  bool Value(const int64_t absVar) const { return _model[absVar]; }
+  // The first clause violated by the model, or -1 if none. The clauses of up to 3 literals are counted first,
+  //   followed by the assumptions, then the longer clauses.
+  int64_t FailedClause() const { return _failedClause; }
+  // Checks a model found elsewhere, e.g. by a worker process, against the clauses added so far. |model| holds the
+  //   values of the variables up to VarCount(). Returns the first clause violated, or -1 if none.
+  int64_t CheckModel(const std::vector<bool> &model) const { return firstFailed(_initial, model); }
+  // The high-water mark of the frontiers of the last Solve().
+  int64_t FrontierHighWater() const;
+};
@@ -0,0 +1,146 @@
+#include "stdafx.h"
+#include "Solver2Sat.h"
+#include "Stats.h"
+
+namespace {
+  thread_local Solver2Sat tlSolver2Sat;
+}
+
+Solver2Sat& Solver2Sat::ForThread() {
+  return tlSolver2Sat;
+}
+
+void Solver2Sat::mapVar(const int64_t absVar) {
+  if (_stamps[absVar] == _epoch) {
+    return;
+  }
+  _stamps.UnshadowedModify(absVar) = _epoch;
+  _compact.UnshadowedModify(absVar) = _vars.size();
+  _vars.emplace_back();
+  _vars.UnshadowedModifyBack() = absVar;
+}
+
+template<typename TIdx> void Solver2Sat::buildGraph(const Problem<TIdx> &prob) {
+  const int64_t nProbVars = prob._varVal.size();
+  if (_stamps.size() < nProbVars) {
+    _stamps.AssignZeros(nProbVars);
+    _compact.AssignZeros(nProbVars, false);
+    _epoch = 0;
+  }
+  _epoch++;
+  _vars.SetSize(0);
+  const int64_t nCl2 = prob._cl2.size();
+  for (int64_t i = 0; i < nCl2; i++) {
+    for (int8_t j = 0; j < 2; j++) {
+      mapVar(abs(prob._cl2[i]._vars[j]));
+    }
+  }
+
+  //// Count the out-degrees, then place each clause a|b as the edges -a->b and -b->a
+  const int64_t nVerts = 2 * _vars.size();
+  _adjStart.AssignZeros(nVerts + 1);
+  for (int64_t i = 0; i < nCl2; i++) {
+    const Clause2<TIdx> &cl = prob._cl2[i];
+    _adjStart.UnshadowedModify(vertexOf(-cl._vars[0]) + 1)++;
+    _adjStart.UnshadowedModify(vertexOf(-cl._vars[1]) + 1)++;
+  }
+  for (int64_t v = 0; v < nVerts; v++) {
+    _adjStart.UnshadowedModify(v + 1) += _adjStart[v];
+  }
+  _adj.AssignZeros(2 * nCl2, false);
+  // The traversal cursors serve as the fill cursors here.
+  _iNextAdj.AssignZeros(nVerts, false);
+  for (int64_t v = 0; v < nVerts; v++) {
+    _iNextAdj.UnshadowedModify(v) = _adjStart[v];
+  }
+  for (int64_t i = 0; i < nCl2; i++) {
+    const Clause2<TIdx> &cl = prob._cl2[i];
+    _adj.UnshadowedModify(_iNextAdj.UnshadowedModify(vertexOf(-cl._vars[0]))++) = vertexOf(cl._vars[1]);
+    _adj.UnshadowedModify(_iNextAdj.UnshadowedModify(vertexOf(-cl._vars[1]))++) = vertexOf(cl._vars[0]);
+  }
+}
+
+void Solver2Sat::visit(const int64_t v, int64_t &counter) {
+  counter++;
+  _index.UnshadowedModify(v) = counter;
+  _low.UnshadowedModify(v) = counter;
+  _iNextAdj.UnshadowedModify(v) = _adjStart[v];
+  _sccStack.emplace_back();
+  _sccStack.UnshadowedModifyBack() = v;
+  _callStack.emplace_back();
+  _callStack.UnshadowedModifyBack() = v;
+}
+
+void Solver2Sat::computeScc(int64_t &nScc) {
+  const int64_t nVerts = 2 * _vars.size();
+  _index.AssignZeros(nVerts);
+  _low.AssignZeros(nVerts, false);
+  _scc.AssignZeros(nVerts, false);
+  for (int64_t v = 0; v < nVerts; v++) {
+    _scc.UnshadowedModify(v) = -1;
+  }
+  _sccStack.SetSize(0);
+  _callStack.SetSize(0);
+  int64_t counter = 0;
+  nScc = 0;
+  for (int64_t root = 0; root < nVerts; root++) {
+    if (_index[root] != 0) {
+      continue;
+    }
+    visit(root, counter);
+    while (_callStack.size() > 0) {
+      const int64_t v = _callStack.back();
+      if (_iNextAdj[v] < _adjStart[v + 1]) {
+        const int64_t w = _adj[_iNextAdj[v]];
+        _iNextAdj.UnshadowedModify(v)++;
+        if (_index[w] == 0) {
+          visit(w, counter);
+        }
+        else if (_scc[w] < 0) { // on the SCC stack
+          _low.UnshadowedModify(v) = std::min(_low[v], _index[w]);
+        }
+        continue;
+      }
+      _callStack.SetSize(_callStack.size() - 1);
+      if (_low[v] == _index[v]) {
+        int64_t w;
+        do {
+          w = _sccStack.back();
+          _sccStack.SetSize(_sccStack.size() - 1);
+          _scc.UnshadowedModify(w) = nScc;
+        } while (w != v);
+        nScc++;
+      }
+      if (_callStack.size() > 0) {
+        const int64_t u = _callStack.back();
+        _low.UnshadowedModify(u) = std::min(_low[u], _low[v]);
+      }
+    }
+  }
+}
+
+template<typename TIdx> bool Solver2Sat::Run(const Problem<TIdx> &prob) {
+  Stats::Local().Add(WorkerStats::cSolver2SatRuns, 1);
+  buildGraph(prob);
+  int64_t nScc;
+  computeScc(nScc);
+  for (int64_t i = 0; i < _vars.size(); i++) {
+    // A variable and its negation in the same SCC
+    if (_scc[2 * i] == _scc[2 * i + 1]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Solver2Sat::Value(const int64_t absVar) const {
+  if (absVar >= _stamps.size() || _stamps[absVar] != _epoch) {
+    return false;
+  }
+  const int64_t c = _compact[absVar];
+  // The SCCs are completed in the reverse topological order, so the literal completed first is implied by the other.
+  return _scc[2 * c] < _scc[2 * c + 1];
+}
+
+template bool Solver2Sat::Run(const Problem<int32_t> &prob);
+template bool Solver2Sat::Run(const Problem<int64_t> &prob);
@@ -2,161 +2,47 @@
 
 #include "Problem.h"
 
-// Taken from https://www.geeksforgeeks.org/2-satisfiability-2-sat-problem/
-struct Solver2Sat {
-  FastVector<FastVector<int64_t>> _adj;
-  FastVector<FastVector<int64_t>> _adjInv;
-  std::vector<bool> _visited;
-  std::vector<bool> _visitedInv;
-  FastVector<int64_t> _st;
-  // The strongly-connected component for this vertex.
+// A 2-SAT engine over the unknown variables occurring in the 2-clauses of a problem. The buffers are reused across
+//   the calls, so that a check costs O(|cl2|) rather than O(N) and allocates nothing once the buffers have grown.
+class Solver2Sat {
+  // The variables are renumbered compactly in the order of appearance. The vertex of a literal is twice the
+  //   compact index of its variable, plus 1 if the literal is negative.
+  FastVector<int64_t> _vars;
+  // The compact index of a problem variable, valid iff its stamp equals the epoch.
+  FastVector<int64_t> _compact;
+  FastVector<int64_t> _stamps;
+  int64_t _epoch = 0;
+
+  // The implication graph in the CSR form: the successors of vertex v are at [_adjStart[v], _adjStart[v+1]).
+  FastVector<int64_t> _adjStart;
+  FastVector<int64_t> _adj;
+
+  //// Tarjan's algorithm, with explicit stacks instead of the recursion
+  // 0 for the unvisited vertices, otherwise the visit order plus 1.
+  FastVector<int64_t> _index;
+  FastVector<int64_t> _low;
+  // The strongly-connected component of a vertex, in the order of completion, or -1 while it's not completed.
   FastVector<int64_t> _scc;
-  // The number of strongly-connected components
-  int64_t _counter = 1;
-  int64_t _N; // number of variables
-  int64_t _M; // number of 2-cnf clauses
+  FastVector<int64_t> _sccStack;
+  FastVector<int64_t> _callStack;
+  // The next successor to visit from a vertex on the call stack.
+  FastVector<int64_t> _iNextAdj;
 
-  // adds edges to form the original graph 
-  void addEdges(const int64_t a, const int64_t b) {
-    _adj.UnshadowedModify(a).emplace_back();
-    _adj.UnshadowedModify(a).UnshadowedModifyBack() = b;
+  int64_t vertexOf(const int64_t signedVar) const {
+    return 2 * _compact[abs(signedVar)] + (signedVar < 0 ? 1 : 0);
   }
+  void mapVar(const int64_t absVar);
+  template<typename TIdx> void buildGraph(const Problem<TIdx> &prob);
+  void visit(const int64_t v, int64_t &counter);
+  void computeScc(int64_t &nScc);
 
-  // add edges to form the inverse graph 
-  void addEdgesInverse(const int64_t a, const int64_t b) {
-    _adjInv.UnshadowedModify(b).emplace_back();
-    _adjInv.UnshadowedModify(b).UnshadowedModifyBack() = a;
-  }
-
-  // for STEP 1 of Kosaraju's Algorithm 
-  void dfsFirst(const int64_t u) {
-    if (_visited[u])
-      return;
-
-    _visited[u] = true;
-
-    for (int i = 0; i < _adj[u].size(); i++)
-      dfsFirst(_adj[u][i]);
-
-    _st.emplace_back();
-    _st.UnshadowedModifyBack() = u;
-  }
-
-  // for STEP 2 of Kosaraju's Algorithm 
-  void dfsSecond(const int64_t u) {
-    if (_visitedInv[u])
-      return;
-
-    _visitedInv[u] = true;
-
-    for (int i = 0; i < _adjInv[u].size(); i++)
-      dfsSecond(_adjInv[u][i]);
-
-    _scc.UnshadowedModify(u) = _counter;
-  }
+public:
+  static Solver2Sat& ForThread();
 
-  Solver2Sat(const Problem& prob) {
-    _N = prob._varVal.size() - 1;
-    _M = prob._cl2.size();
-    const int64_t nVertBuf = 2 * _N + 1;
-    _adj.AssignZeros(nVertBuf, false);
-    _adjInv.AssignZeros(nVertBuf, false);
-    for (int64_t i = 0; i < nVertBuf; i++) {
-      new(&_adj.UnshadowedModify(i)) FastVector<int64_t>();
-      new(&_adjInv.UnshadowedModify(i)) FastVector<int64_t>();
-    }
-    _visited.resize(nVertBuf);
-    _visitedInv.resize(nVertBuf);
-    _scc.AssignZeros(nVertBuf, false);
+  // Returns |false| if the 2-clauses are unsatisfiable.
+  // Returns |true| if the 2-clauses are satisfiable, and then Value() gives a model.
+  template<typename TIdx> bool Run(const Problem<TIdx> &prob);
 
-    // adding edges to the graph 
-    for (int64_t i = 0; i < _M; i++) {
-      // variable x is mapped to x 
-      // variable -x is mapped to n+x = n-(-x) 
-
-      // for a[i] or b[i], addEdges -a[i] -> b[i] 
-      // AND -b[i] -> a[i] 
-      const int64_t a = prob._cl2[i]._vars[0];
-      const int64_t b = prob._cl2[i]._vars[1];
-      if (a > 0 && b > 0) {
-        addEdges(a + _N, b);
-        addEdgesInverse(a + _N, b);
-        addEdges(b + _N, a);
-        addEdgesInverse(b + _N, a);
-      }
-      else if (a > 0 && b < 0) {
-        addEdges(a + _N, _N - b);
-        addEdgesInverse(a + _N, _N - b);
-        addEdges(-b, a);
-        addEdgesInverse(-b, a);
-      }
-      else if (a < 0 && b > 0) {
-        addEdges(-a, b);
-        addEdgesInverse(-a, b);
-        addEdges(b + _N, _N - a);
-        addEdgesInverse(b + _N, _N - a);
-      } 
-      else {
-        addEdges(-a, _N - b);
-        addEdgesInverse(-a, _N - b);
-        addEdges(-b, _N - a);
-        addEdgesInverse(-b, _N - a);
-      }
-    }
-  }
-  ~Solver2Sat() {
-    const int64_t nVertBuf = 2 * _N + 1;
-    for (int64_t i = 0; i < nVertBuf; i++) {
-      _adj.UnshadowedModify(i).~FastVector();
-      _adjInv.UnshadowedModify(i).~FastVector();
-    }
-  }
-
-  bool HasSolution() {
-    // STEP 1 of Kosaraju's Algorithm which 
-    // traverses the original graph 
-    for (int64_t i = 1; i <= 2 * _N; i++) {
-      if (!_visited[i]) {
-        dfsFirst(i);
-      }
-    }
-
-    // STEP 2 pf Kosaraju's Algorithm which 
-    // traverses the inverse graph. After this, 
-    // array scc[] stores the corresponding value 
-    while (_st.size() > 0) {
-      const int64_t n = _st.back();
-      _st.SetSize(_st.size() - 1);
-
-      if (!_visitedInv[n]) {
-        dfsSecond(n);
-        _counter++;
-      }
-    }
-
-    for (int64_t i = 1; i <= _N; i++) {
-      // for any 2 vairable x and -x lie in 
-      // same SCC 
-      if (_scc[i] == _scc[i + _N]) {
-        return false;
-      }
-    }
-    return true;
-  }
-
-  bool Solve(Problem& prob) {
-    if (!HasSolution()) {
-      return false;
-    }
-    // Taken from https://cp-algorithms.com/graph/2SAT.html
-    for (int64_t i = 1; i <= _N; i++) {
-      if (prob._varKnown[i]) { // unreachable known variable assignment
-        continue;
-      }
-      prob._varKnown[i] = true;
-      prob._varVal[i] = _scc[i] > _scc[i + _N];
-    }
-    return true;
-  }
+  // The value of the variable in the model found by the last Run(): |false| for the variables not in the 2-clauses.
+  bool Value(const int64_t absVar) const;
 };
-
@@ -0,0 +1,91 @@
+#include "stdafx.h"
+#include "SpillFile.h"
+
+std::atomic<int64_t> SpillFile::_nCreated(0);
+
+bool SpillFile::create() {
+  const std::string dir = _dir.empty() ? std::string(".") : _dir;
+  _path = dir + "/maxelim-" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(_nCreated.fetch_add(1))
+    + ".spill";
+  _fp = fopen(_path.c_str(), "w+b");
+  if (_fp == nullptr) {
+    fprintf(stderr, "Cannot create the spill file %s, keeping the frontier in memory.\n", _path.c_str());
+    _bFailed.store(true);
+    return false;
+  }
+  return true;
+}
+
+int64_t SpillFile::Append(const std::vector<uint8_t> &record) {
+  if (_bFailed || (_fp == nullptr && !create())) {
+    return -1;
+  }
+  const int64_t nBytes = int64_t(record.size());
+  const auto itFit = _freeBySize.lower_bound({ nBytes, 0 });
+  const int64_t offset = (itFit == _freeBySize.end()) ? _size : itFit->second;
+  if (_fseeki64(_fp, offset, SEEK_SET) != 0 || fwrite(record.data(), 1, record.size(), _fp) != record.size()) {
+    fprintf(stderr, "Cannot write the spill file %s, keeping the frontier in memory.\n", _path.c_str());
+    _bFailed.store(true);
+    return -1;
+  }
+  if (itFit == _freeBySize.end()) {
+    _size += nBytes;
+    return offset;
+  }
+  //// Keep the rest of the extent released
+  const int64_t nFree = itFit->first;
+  _freeBySize.erase(itFit);
+  _freeByOffset.erase({ offset, nFree });
+  if (nFree > nBytes) {
+    _freeByOffset.insert({ offset + nBytes, nFree - nBytes });
+    _freeBySize.insert({ nFree - nBytes, offset + nBytes });
+  }
+  return offset;
+}
+
+void SpillFile::Release(const int64_t offset, const int64_t nBytes) {
+  int64_t begin = offset;
+  int64_t end = offset + nBytes;
+  //// Merge with the released neighbours
+  auto itNext = _freeByOffset.lower_bound({ end, 0 });
+  if (itNext != _freeByOffset.end() && itNext->first == end) {
+    end += itNext->second;
+    _freeBySize.erase({ itNext->second, itNext->first });
+    itNext = _freeByOffset.erase(itNext);
+  }
+  if (itNext != _freeByOffset.begin()) {
+    const auto itPrev = std::prev(itNext);
+    if (itPrev->first + itPrev->second == begin) {
+      begin = itPrev->first;
+      _freeBySize.erase({ itPrev->second, itPrev->first });
+      _freeByOffset.erase(itPrev);
+    }
+  }
+  if (end == _size) {
+    _size = begin;
+    return;
+  }
+  _freeByOffset.insert({ begin, end - begin });
+  _freeBySize.insert({ end - begin, begin });
+}
+
+void SpillFile::Read(const int64_t offset, const int64_t nBytes, std::vector<uint8_t> &record) {
+  record.resize(nBytes);
+  if (_fseeki64(_fp, offset, SEEK_SET) != 0 || fread(record.data(), 1, nBytes, _fp) != size_t(nBytes)) {
+    // The record holds part of the search, so the answer would be wrong without it.
+    fprintf(stderr, "Cannot read the spill file %s at %lld.\n", _path.c_str(), offset);
+    __debugbreak();
+  }
+}
+
+void SpillFile::Close() {
+  if (_fp == nullptr) {
+    return;
+  }
+  fclose(_fp);
+  _fp = nullptr;
+  remove(_path.c_str());
+  _size = 0;
+  _freeByOffset.clear();
+  _freeBySize.clear();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// A scratch file of records, written at their offsets and read back from there. The space of the released records
+//   is reused, so the file grows with the records alive at once rather than all the records written. The file is
+//   created on the first write in the given directory, and deleted when closed.
+class SpillFile {
+  static std::atomic<int64_t> _nCreated;
+
+  std::string _dir;
+  std::string _path;
+  FILE *_fp = nullptr;
+  int64_t _size = 0;
+  // The released extents before |_size| as (offset, size) and as (size, offset). The adjacent ones are merged, and
+  //   those reaching |_size| shrink it instead.
+  std::set<std::pair<int64_t, int64_t>> _freeByOffset;
+  std::set<std::pair<int64_t, int64_t>> _freeBySize;
+  // Set once creating or writing the file has failed, so that the caller keeps the records in memory instead.
+  std::atomic<bool> _bFailed = false;
+
+  bool create();
+
+public:
+  SpillFile() { }
+  ~SpillFile() { Close(); }
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+
+  void SetDir(const std::string &dir) { _dir = dir; }
+  bool Failed() const { return _bFailed.load(std::memory_order_relaxed); }
+
+  // Writes the record into the smallest released extent that fits, otherwise at the end.
+  // Returns the offset of the record, or -1 if the write has failed.
+  int64_t Append(const std::vector<uint8_t> &record);
+  void Read(const int64_t offset, const int64_t nBytes, std::vector<uint8_t> &record);
+  // Lets the next records reuse the space of the one at |offset|, which has been read back.
+  void Release(const int64_t offset, const int64_t nBytes);
+  void Close();
+};
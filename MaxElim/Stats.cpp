@@ -0,0 +1,122 @@
+#include "stdafx.h"
+#include "Stats.h"
+#include "SpinLock.h"
+#include "MemPool.h"
+#include "Kernels.h"
+
+thread_local WorkerStats *Stats::_pLocal = nullptr;
+
+namespace {
+  const char* const gcCounterKeys[WorkerStats::cnCounters] = { "nodes", "probes", "apply_var", "apply_assigned",
+    "apply_max_chain", "forced_lits", "solver2sat_runs", "conflicts", "pre_subsumed", "pre_strengthened",
+    "pre_eliminated", "pre_substituted", "restores", "restore_bytes", "pool_hits", "pool_misses",
+    "pool_refills", "pool_spills", "pool_trims", "frontier_spilled", "frontier_spill_bytes", "frontier_unspilled",
+    "wait_ns" };
+
+  BOOL WINAPI OnConsoleCtrl(DWORD ctrlType) {
+    if (ctrlType != CTRL_BREAK_EVENT) {
+      return FALSE;
+    }
+    // Windows calls the handler in a thread of its own, so it may print.
+    Stats::Instance().Print(stderr);
+    return TRUE;
+  }
+}
+
+WorkerStats& Stats::registerThread() {
+  Stats &stats = Instance();
+  const int64_t at = stats._nWorkers.fetch_add(1);
+  if (at >= _cMaxThreads) {
+    return stats._overflow;
+  }
+  WorkerStats *pWs = new WorkerStats();
+  stats._workers[at].store(pWs);
+  return *pWs;
+}
+
+Stats& Stats::Instance() {
+  // Constructed on the first use, as the memory pools may count before main(). Intentionally leaked, so that the
+  //   dump thread and the console handler can use it while the process exits.
+  static Stats *pStats = new Stats();
+  return *pStats;
+}
+
+int64_t Stats::Total(const WorkerStats::Counter c) const {
+  const bool bMax = (c == WorkerStats::cApplyMaxChain);
+  int64_t ans = _overflow._counters[c].load(std::memory_order_relaxed);
+  const int64_t nWorkers = std::min(_nWorkers.load(), _cMaxThreads);
+  for (int64_t i = 0; i < nWorkers; i++) {
+    // A thread which has just claimed the slot may not have stored the pointer yet.
+    const WorkerStats *pWs = _workers[i].load();
+    if (pWs == nullptr) {
+      continue;
+    }
+    const int64_t value = pWs->_counters[c].load(std::memory_order_relaxed);
+    ans = bMax ? std::max(ans, value) : ans + value;
+  }
+  return ans;
+}
+
+void Stats::Print(FILE *fp) const {
+  const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - _tStart).count();
+  const double perSec = 1 / std::max(wallSec, 1e-9);
+  fprintf(fp, "[%.3f s] nodes=%lld probes=%lld (%.0f/s) apply_var=%lld (%.0f/s) assigned=%lld max_chain=%lld"
+    " forced=%lld 2sat=%lld conflicts=%lld pre=%lld/%lld/%lld/%lld restores=%lld (%.1f MB) pool=%lld/%lld"
+    " refills=%lld spills=%lld trims=%lld os=%.1f MB central=%.1f MB disk=%lld/%lld (%.1f MB) wait=%.3f s"
+    " spin_contention=%llu\n", wallSec,
+    Total(WorkerStats::cNodes), Total(WorkerStats::cProbes), Total(WorkerStats::cProbes) * perSec,
+    Total(WorkerStats::cApplyVar), Total(WorkerStats::cApplyVar) * perSec, Total(WorkerStats::cApplyAssigned),
+    Total(WorkerStats::cApplyMaxChain), Total(WorkerStats::cForcedLits), Total(WorkerStats::cSolver2SatRuns),
+    Total(WorkerStats::cConflicts), Total(WorkerStats::cPreSubsumed), Total(WorkerStats::cPreStrengthened),
+    Total(WorkerStats::cPreEliminated), Total(WorkerStats::cPreSubstituted), Total(WorkerStats::cRestores),
+    Total(WorkerStats::cRestoreBytes) / double(1 << 20), Total(WorkerStats::cPoolHits),
+    Total(WorkerStats::cPoolHits) + Total(WorkerStats::cPoolMisses),
+    Total(WorkerStats::cPoolRefills), Total(WorkerStats::cPoolSpills), Total(WorkerStats::cPoolTrims),
+    MemPool::OsBytes() / double(1 << 20), MemPool::CentralBytes() / double(1 << 20),
+    Total(WorkerStats::cFrontierSpilled), Total(WorkerStats::cFrontierUnspilled),
+    Total(WorkerStats::cFrontierSpillBytes) / double(1 << 20), Total(WorkerStats::cWaitNs) * 1e-9,
+    SpinStatistics::TotalContention());
+  fflush(fp);
+}
+
+void Stats::StartDumps(const double periodSec) {
+  SetConsoleCtrlHandler(OnConsoleCtrl, TRUE);
+  if (periodSec <= 0) {
+    return;
+  }
+  std::thread([this, periodSec] {
+    for (;;) {
+      std::this_thread::sleep_for(std::chrono::duration<double>(periodSec));
+      Print(stderr);
+    }
+  }).detach();
+}
+
+void Stats::Report(const char *fn, const char *result, const int64_t frontierHighWater) const {
+  Print(stderr);
+  if (fn == nullptr) {
+    return;
+  }
+  const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - _tStart).count();
+  PROCESS_MEMORY_COUNTERS pmc;
+  pmc.PeakWorkingSetSize = 0;
+  GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+
+  FILE *fpStats = fopen(fn, "wt");
+  if (fpStats == nullptr) {
+    fprintf(stderr, "Cannot write the statistics to %s\n", fn);
+    return;
+  }
+  fprintf(fpStats, "result=%s\n", result);
+  fprintf(fpStats, "wall_sec=%.6f\n", wallSec);
+  for (int8_t i = 0; i < WorkerStats::cnCounters; i++) {
+    fprintf(fpStats, "%s=%lld\n", gcCounterKeys[i], Total(WorkerStats::Counter(i)));
+  }
+  fprintf(fpStats, "spin_contention=%llu\n", SpinStatistics::TotalContention());
+  fprintf(fpStats, "pool_os_bytes=%lld\n", MemPool::OsBytes());
+  fprintf(fpStats, "pool_central_bytes=%lld\n", MemPool::CentralBytes());
+  fprintf(fpStats, "peak_rss_bytes=%lld\n", int64_t(pmc.PeakWorkingSetSize));
+  fprintf(fpStats, "frontier_high_water=%lld\n", frontierHighWater);
+  fprintf(fpStats, "simd=%s\n", Kernels::IsaName(Kernels::Current()));
+  fclose(fpStats);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+// The counters of one thread, on their own cache line. Only the owner thread updates them, so the updates are
+//   plain loads and stores rather than locked read-modify-writes, yet another thread can aggregate them meanwhile.
+struct alignas(64) WorkerStats {
+  enum Counter {
+    // The search nodes popped from the frontier, or the decisions of the CDCL engine.
+    cNodes,
+    // The candidates evaluated by the lookahead.
+    cProbes,
+    cApplyVar,
+    // The variables assigned by ApplyVar() including the implied ones, and the longest such chain in one call.
+    cApplyAssigned,
+    cApplyMaxChain,
+    // The literals found forced by the lookahead, times the children they are applied to.
+    cForcedLits,
+    cSolver2SatRuns,
+    cConflicts,
+    // The clauses removed by subsumption and the literals removed by self-subsuming resolution in preprocessing,
+    //   and the variables eliminated by resolution or substituted by an equivalent literal.
+    cPreSubsumed,
+    cPreStrengthened,
+    cPreEliminated,
+    cPreSubstituted,
+    cRestores,
+    // The bytes copied back by ShadowProblem::Restore() from the dirty chunks or from the undo trail.
+    cRestoreBytes,
+    // The blocks acquired from the cache of the thread, and those allocated from the OS.
+    cPoolHits,
+    cPoolMisses,
+    // The blocks moved from the central tier to the thread cache and back, and those spilled to the OS.
+    cPoolRefills,
+    cPoolSpills,
+    cPoolTrims,
+    // The frontier items written to the spill file, their bytes, and the items read back.
+    cFrontierSpilled,
+    cFrontierSpillBytes,
+    cFrontierUnspilled,
+    // The time the worker slept in Pipeline::Pop() for lack of work.
+    cWaitNs,
+    cnCounters
+  };
+
+  std::atomic<int64_t> _counters[cnCounters];
+
+  WorkerStats() {
+    for (int8_t i = 0; i < cnCounters; i++) {
+      _counters[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void Add(const Counter c, const int64_t delta) {
+    _counters[c].store(_counters[c].load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+  }
+
+  void Max(const Counter c, const int64_t value) {
+    if (value > _counters[c].load(std::memory_order_relaxed)) {
+      _counters[c].store(value, std::memory_order_relaxed);
+    }
+  }
+};
+
+// The counters of a run: aggregated over the threads on demand, dumped on Ctrl+Break or periodically, and reported
+//   at exit.
+class Stats {
+  static const int64_t _cMaxThreads = 1 << 10;
+  thread_local static WorkerStats *_pLocal;
+
+  std::chrono::steady_clock::time_point _tStart = std::chrono::steady_clock::now();
+  // The counters of the threads are never freed, so that those of the exited threads still count.
+  std::atomic<WorkerStats*> _workers[_cMaxThreads] = {};
+  std::atomic<int64_t> _nWorkers = 0;
+  // The counters of the threads beyond |_cMaxThreads|.
+  WorkerStats _overflow;
+
+  static WorkerStats& registerThread();
+
+public:
+  static Stats& Instance();
+
+  static WorkerStats& Local() {
+    if (_pLocal == nullptr) {
+      _pLocal = &registerThread();
+    }
+    return *_pLocal;
+  }
+
+  // Sums the counter over the threads, or takes the maximum for the maxima.
+  int64_t Total(const WorkerStats::Counter c) const;
+
+  // Prints the counters in the human-readable form.
+  void Print(FILE *fp) const;
+
+  // Prints the counters to stderr every |periodSec| seconds, if positive, and whenever Ctrl+Break is pressed.
+  void StartDumps(const double periodSec);
+
+  // Prints the counters to stderr and, if |fn| isn't nullptr, writes them to the file as key=value lines.
+  void Report(const char *fn, const char *result, const int64_t frontierHighWater) const;
+};
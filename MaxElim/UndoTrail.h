@@ -0,0 +1,52 @@
+#pragma once
+
+#include "FastVector.h"
+
+template<typename T> class CowVector;
+
+// A journal of the old values of the items modified in a problem, so that a probe can be rolled back in time
+//   proportional to the work the probe did.
+// The items are restored through the vector rather than by address, because a chunk may become shared (e.g. with
+//   the best candidate so far) before the rollback.
+struct UndoTrail {
+  typedef void (*TRestore)(void *pVect, const int64_t at, const uint64_t *pOld);
+
+  // Each entry is laid out as: the old item, the vector, the index, the restore function, the item size in words.
+  FastVector<uint64_t> _log;
+
+  // The sizes of the vectors must be restored before the rollback: the items beyond are irrelevant.
+  template<typename T> static void RestoreItem(void *pVect, const int64_t at, const uint64_t *pOld) {
+    CowVector<T> &vect = *reinterpret_cast<CowVector<T>*>(pVect);
+    if (at < vect.size()) {
+      memcpy(&vect.UnshadowedModify(at), pOld, sizeof(T));
+    }
+  }
+
+  template<typename T> void Log(CowVector<T> &vect, const int64_t at, const T& old) {
+    // The items narrower than a multiple of words, e.g. with 32-bit indices, occupy whole words in the log.
+    const int64_t nWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    const int64_t iFirst = _log.size();
+    for (int64_t i = 0; i < nWords + 4; i++) {
+      _log.emplace_back();
+    }
+    memcpy(&_log.UnshadowedModify(iFirst), &old, sizeof(T));
+    _log.UnshadowedModify(iFirst + nWords) = reinterpret_cast<uint64_t>(&vect);
+    _log.UnshadowedModify(iFirst + nWords + 1) = uint64_t(at);
+    _log.UnshadowedModify(iFirst + nWords + 2) = reinterpret_cast<uint64_t>(&RestoreItem<T>);
+    _log.UnshadowedModify(iFirst + nWords + 3) = uint64_t(nWords);
+  }
+
+  // Restores the logged items in the reverse order, so the oldest value of each item wins.
+  void Rollback() {
+    int64_t iEnd = _log.size();
+    while (iEnd > 0) {
+      const int64_t nWords = int64_t(_log[iEnd - 1]);
+      const TRestore pfnRestore = reinterpret_cast<TRestore>(_log[iEnd - 2]);
+      const int64_t at = int64_t(_log[iEnd - 3]);
+      void *pVect = reinterpret_cast<void*>(_log[iEnd - 4]);
+      iEnd -= nWords + 4;
+      pfnRestore(pVect, at, &_log[iEnd]);
+    }
+    _log.SetSize(0);
+  }
+};
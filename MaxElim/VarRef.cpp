@@ -3,324 +3,197 @@
 #include "Problem.h"
 #include "ShadowProblem.h"
 
-template<int8_t taClauseSz> AVLNode & VarRef<taClauseSz>::getNode(const int64_t iNode) {
-  return _pProb->_vrc._avlNp._nodes.Modify(iNode, _pProb->AvlNodesShadow());
-}
-
-template<int8_t taClauseSz> const AVLNode & VarRef<taClauseSz>::getNode(const int64_t iNode) const {
-  return _pProb->_vrc._avlNp._nodes[iNode];
-}
-
-//// Taken from: https://www.geeksforgeeks.org/avl-tree-set-1-insertion/
-// A utility function to get the height of the tree 
-template<int8_t taClauseSz> int64_t VarRef<taClauseSz>::height(const int64_t iNode) {
-  if (iNode < 0) {
-    return 0;
+template<int8_t taClauseSz, typename TIdx>
+int64_t VarRef<taClauseSz, TIdx>::clauseSize(const int64_t iClause, const TProblem &prob) {
+  if constexpr (taClauseSz == cClauseSzLong) {
+    return prob._clk[iClause]._size;
   }
-  return getNode(iNode)._height;
-}
-
-/* Helper function that allocates a new node with the given key and
-NULL left and right pointers. */
-template<int8_t taClauseSz> int64_t VarRef<taClauseSz>::newNode(const int64_t key) {
-  const int64_t index = _pProb->_vrc._avlNp.Acquire();
-  AVLNode& node = getNode(index);
-  node._key = key;
-  node._iLeft = -1;
-  node._iRight = -1;
-  node._height = 1;  // new node is initially added at leaf 
-  return index;
-}
-
-// A utility function to right rotate subtree rooted with y 
-// See the diagram given above. 
-template<int8_t taClauseSz> int64_t VarRef<taClauseSz>::rightRotate(const int64_t y) {
-  const int64_t x = getNode(y)._iLeft;
-  const int64_t T2 = getNode(x)._iRight;
-
-  // Perform rotation
-  getNode(x)._iRight = y;
-  getNode(y)._iLeft = T2;
-
-  // Update heights 
-  getNode(y)._height = std::max(height(getNode(y)._iLeft), height(getNode(y)._iRight)) + 1;
-  getNode(x)._height = std::max(height(getNode(x)._iLeft), height(getNode(x)._iRight)) + 1;
-
-  // Return new root 
-  return x;
-}
-
-// A utility function to left rotate subtree rooted with x 
-// See the diagram given above. 
-template<int8_t taClauseSz> int64_t VarRef<taClauseSz>::leftRotate(const int64_t x) {
-  const int64_t y = getNode(x)._iRight;
-  const int64_t T2 = getNode(y)._iLeft;
-
-  // Perform rotation 
-  getNode(y)._iLeft = x;
-  getNode(x)._iRight = T2;
-
-  //  Update heights 
-  getNode(x)._height = std::max(height(getNode(x)._iLeft), height(getNode(x)._iRight)) + 1;
-  getNode(y)._height = std::max(height(getNode(y)._iLeft), height(getNode(y)._iRight)) + 1;
-
-  // Return new root 
-  return y;
-}
-
-// Get Balance factor of node N 
-template<int8_t taClauseSz> int64_t VarRef<taClauseSz>::getBalance(const int64_t iNode) {
-  if (iNode < 0) {
-    return 0;
+  else {
+    return taClauseSz;
   }
-  return height(getNode(iNode)._iLeft) - height(getNode(iNode)._iRight);
 }
 
-// Recursive function to insert a key in the subtree rooted 
-// with node and returns the new root of the subtree. 
-template<int8_t taClauseSz> int64_t VarRef<taClauseSz>::insert(const int64_t iNode, const int64_t key) {
-  /* 1.  Perform the normal BST insertion */
-  if (iNode < 0)
-    return newNode(key);
-
-  if (key < getNode(iNode)._key) {
-    const int64_t newLeft = insert(getNode(iNode)._iLeft, key);
-    getNode(iNode)._iLeft = newLeft;
+template<int8_t taClauseSz, typename TIdx>
+int64_t VarRef<taClauseSz, TIdx>::clauseVar(const int64_t iClause, const int64_t j, const TProblem &prob) {
+  static_assert(taClauseSz == 2 || taClauseSz == 3 || taClauseSz == cClauseSzLong,
+    "We only support 2-, 3- and long clauses.");
+  if constexpr (taClauseSz == 2) {
+    return prob._cl2[iClause]._vars[j];
   }
-  else if (key > getNode(iNode)._key) {
-    const int64_t newRight = insert(getNode(iNode)._iRight, key);
-    getNode(iNode)._iRight = newRight;
+  else if constexpr (taClauseSz == 3) {
+    return prob._cl3[iClause]._vars[j];
   }
   else {
-    fprintf(stderr, "Duplicate entry of variable %lld in clause %lld.\n", _var, key);
-    quick_exit(7);
-    //return iNode; // we would return this if it wouldn't be an error
+    return prob._litsK[prob._clk[iClause]._iFirst + j];
   }
+}
 
-  /* 2. Update height of this ancestor node */
-  getNode(iNode)._height = 1 + std::max(height(getNode(iNode)._iLeft), height(getNode(iNode)._iRight));
-
-  /* 3. Get the balance factor of this ancestor
-  node to check whether this node became
-  unbalanced */
-  const int64_t balance = getBalance(iNode);
-
-  // If this node becomes unbalanced, then 
-  // there are 4 cases 
-
-  if (balance > 1) {
-    if (key < getNode(getNode(iNode)._iLeft)._key) {
-      // Left Left Case
-      return rightRotate(iNode);
-    }
-    else {
-      // Left Right Case
-      getNode(iNode)._iLeft = leftRotate(getNode(iNode)._iLeft);
-      return rightRotate(iNode);
-    }
+template<int8_t taClauseSz, typename TIdx>
+int64_t VarRef<taClauseSz, TIdx>::backIndex(const int64_t iClause, const int64_t j, const TProblem &prob) {
+  if constexpr (taClauseSz == cClauseSzLong) {
+    return prob._clk[iClause]._iFirst + j;
   }
-
-  if (balance < -1) {
-    if (key > getNode(getNode(iNode)._iRight)._key) {
-      // Right Right Case
-      return leftRotate(iNode);
-    }
-    else {
-      // Right Left Case
-      getNode(iNode)._iRight = rightRotate(getNode(iNode)._iRight);
-      return leftRotate(iNode);
-    }
+  else {
+    return iClause * taClauseSz + j;
   }
-
-  /* return the (unchanged) node pointer */
-  return iNode;
 }
 
-template<int8_t taClauseSz> void VarRef<taClauseSz>::traverse(const int64_t iParent) {
-  if (iParent < 0) {
-    return;
+template<int8_t taClauseSz, typename TIdx>
+int64_t VarRef<taClauseSz, TIdx>::position(const int64_t var, const int64_t iClause, const TProblem &prob) {
+  const int64_t size = clauseSize(iClause, prob);
+  for (int64_t j = 0; j < size; j++) {
+    if (clauseVar(iClause, j, prob) == var) {
+      return j;
+    }
   }
-  traverse(getNode(iParent)._iRight);
-  _pTraversed->emplace_back();
-  _pTraversed->UnshadowedModifyBack() = getNode(iParent)._key;
-  traverse(getNode(iParent)._iLeft);
+  return -1;
 }
 
-template<int8_t taClauseSz> int64_t VarRef<taClauseSz>::findNode(const int64_t iParent, const int64_t key) {
-  if (iParent < 0) {
-    return -1;
-  }
-  if (key < getNode(iParent)._key) {
-    return findNode(getNode(iParent)._iLeft, key);
-  }
-  else if (key > getNode(iParent)._key) {
-    return findNode(getNode(iParent)._iRight, key);
-  }
-  // Found
-  return iParent;
+template<int8_t taClauseSz, typename TIdx>
+VarRefShadow* VarRef<taClauseSz, TIdx>::shadow(const TProblem &prob) {
+  return prob.template OccShadow<taClauseSz>();
 }
 
-/* Given a non-empty binary search tree, return the
-node with minimum key value found in that tree.
-Note that the entire tree does not need to be
-searched. */
-template<int8_t taClauseSz> int64_t VarRef<taClauseSz>::minValueNode(const int64_t iNode) {
-  int64_t current = iNode;
-
-  /* loop down to find the leftmost leaf */
-  while (getNode(current)._iLeft >= 0) {
-    current = getNode(current)._iLeft;
-  }
-
-  return current;
+template<int8_t taClauseSz, typename TIdx>
+OccList<TIdx>& VarRef<taClauseSz, TIdx>::modList(const int64_t iList, TProblem &prob) {
+  VarRefShadow *pShadow = shadow(prob);
+  return _lists.Modify(iList, pShadow == nullptr ? nullptr : &pShadow->_lists, prob.Trail());
 }
 
-//// Taken from https://www.geeksforgeeks.org/avl-tree-set-2-deletion/
-// Recursive function to delete a node with given key 
-// from subtree with given root. It returns root of 
-// the modified subtree. 
-template<int8_t taClauseSz> int64_t VarRef<taClauseSz>::deleteNode(int64_t root, const int64_t key) {
-  // STEP 1: PERFORM STANDARD BST DELETE 
+template<int8_t taClauseSz, typename TIdx>
+TIdx& VarRef<taClauseSz, TIdx>::modSlot(const int64_t iSlot, TProblem &prob) {
+  VarRefShadow *pShadow = shadow(prob);
+  return _slots.Modify(iSlot, pShadow == nullptr ? nullptr : &pShadow->_slots, prob.Trail());
+}
 
-  if (root < 0) {
-    fprintf(stderr, "Cannot find to delete variable %lld in clause %lld.\n", _var, key);
-    __debugbreak();
-    return root; // we would return this if it wouldn't be an error
-  }
+template<int8_t taClauseSz, typename TIdx>
+TIdx& VarRef<taClauseSz, TIdx>::modBack(const int64_t iBack, TProblem &prob) {
+  VarRefShadow *pShadow = shadow(prob);
+  return _back.Modify(iBack, pShadow == nullptr ? nullptr : &pShadow->_back, prob.Trail());
+}
 
-  // If the key to be deleted is smaller than the 
-  // root's key, then it lies in left subtree 
-  if (key < getNode(root)._key) {
-    getNode(root)._iLeft = deleteNode(getNode(root)._iLeft, key);
+template<int8_t taClauseSz, typename TIdx>
+void VarRef<taClauseSz, TIdx>::relocate(const int64_t iList, TProblem &prob) {
+  const OccList<TIdx> old = _lists[iList];
+  const int64_t newCapacity = std::max<int64_t>(_cMinCapacity, old._capacity * 2);
+  const int64_t iNewFirst = _slots.size();
+  for (int64_t i = 0; i < newCapacity; i++) {
+    _slots.emplace_back();
   }
-  // If the key to be deleted is greater than the 
-  // root's key, then it lies in right subtree 
-  else if (key > getNode(root)._key) {
-    getNode(root)._iRight = deleteNode(getNode(root)._iRight, key);
+  // The new slots are beyond the arena size of any shadow, so they needn't be marked.
+  for (int64_t i = 0; i < old._size; i++) {
+    _slots.UnshadowedModify(iNewFirst + i) = _slots[old._iFirst + i];
   }
-  // if key is same as root's key, then This is 
-  // the node to be deleted 
-  else {
-    // node with only one child or no child 
-    if ((getNode(root)._iLeft < 0) || (getNode(root)._iRight < 0)) {
-      int64_t temp = (getNode(root)._iLeft >= 0) ? getNode(root)._iLeft : getNode(root)._iRight;
-
-      // No child case 
-      if (temp < 0) {
-        temp = root;
-        root = -1;
-      }
-      else { // One child case 
-             // Copy the contents of the non-empty child 
-        getNode(root) = getNode(temp);
-      }
-      _pProb->_vrc._avlNp.Release(temp, _pProb->AvlNodesShadow());
-    }
-    else {
-      // node with two children: Get the inorder 
-      // successor (smallest in the right subtree) 
-      const int64_t temp = minValueNode(getNode(root)._iRight);
+  OccList<TIdx> &list = modList(iList, prob);
+  list._iFirst = TIdx(iNewFirst);
+  list._capacity = TIdx(newCapacity);
+}
 
-      // Copy the inorder successor's data to this node 
-      getNode(root)._key = getNode(temp)._key;
+template<int8_t taClauseSz, typename TIdx>
+void VarRef<taClauseSz, TIdx>::Init(const TProblem &prob) {
+  _lists.AssignZeros(2 * prob._vrc._N + 1);
+  _slots.AssignZeros(0);
+  _back.AssignZeros(0);
+}
 
-      // Delete the inorder successor 
-      getNode(root)._iRight = deleteNode(getNode(root)._iRight, getNode(temp)._key);
+template<int8_t taClauseSz, typename TIdx>
+void VarRef<taClauseSz, TIdx>::Compact() {
+  CowVector<TIdx> slots;
+  for (int64_t i = 0; i < _lists.size(); i++) {
+    OccList<TIdx> &list = _lists.UnshadowedModify(i);
+    const int64_t iNewFirst = slots.size();
+    for (int64_t k = 0; k < list._size; k++) {
+      slots.emplace_back();
+      slots.UnshadowedModifyBack() = _slots[list._iFirst + k];
     }
+    list._iFirst = TIdx(iNewFirst);
+    list._capacity = list._size;
   }
+  _slots = std::move(slots);
+}
 
-  // If the tree had only one node then return 
-  if (root < 0)
-    return root;
-
-  // STEP 2: UPDATE HEIGHT OF THE CURRENT NODE 
-  getNode(root)._height = 1 + std::max(height(getNode(root)._iLeft), height(getNode(root)._iRight));
-
-  // STEP 3: GET THE BALANCE FACTOR OF THIS NODE (to 
-  // check whether this node became unbalanced) 
-  const int64_t balance = getBalance(root);
-
-  // If this node becomes unbalanced, then there are 4 cases 
-
-  if (balance > 1) {
-    if (getBalance(getNode(root)._iLeft) >= 0) {
-      // Left Left Case 
-      return rightRotate(root);
-    }
-    else {
-      // Left Right Case 
-      getNode(root)._iLeft = leftRotate(getNode(root)._iLeft);
-      return rightRotate(root);
-    }
+template<int8_t taClauseSz, typename TIdx>
+void VarRef<taClauseSz, TIdx>::Add(const int64_t var, const int64_t iClause, TProblem &prob) {
+  const int64_t j = position(var, iClause, prob);
+  if (j < 0) {
+    fprintf(stderr, "Variable %lld is not in clause %lld.\n", var, iClause);
+    __debugbreak();
+    return;
   }
-
-  if (balance < -1) {
-    if (getBalance(getNode(root)._iRight) <= 0) {
-      // Right Right Case 
-      return leftRotate(root);
-    }
-    else {
-      // Right Left Case 
-      getNode(root)._iRight = rightRotate(getNode(root)._iRight);
-      return leftRotate(root);
-    }
+  const int64_t iList = prob._vrc._N + var;
+  if (_lists[iList]._size >= _lists[iList]._capacity) {
+    relocate(iList, prob);
   }
-
-  return root;
-}
-
-template<int8_t taClauseSz> void VarRef<taClauseSz>::Init(const Problem& prob) {
-  for (int64_t i = 0; i < 2 * prob._vrc._N + 1; i++) {
-    _trees.emplace_back();
-    AVLTree &avlTr = _trees.ModifyBack(prob.TreesShadow<taClauseSz>());
-    avlTr._iRoot = -1;
-    avlTr._size = 0;
+  const int64_t iBack = backIndex(iClause, j, prob);
+  while (_back.size() <= iBack) {
+    _back.emplace_back();
   }
+  OccList<TIdx> &list = modList(iList, prob);
+  modSlot(list._iFirst + list._size, prob) = TIdx(iClause);
+  modBack(iBack, prob) = list._size;
+  list._size++;
 }
 
-template<int8_t taClauseSz> void VarRef<taClauseSz>::Add(const int64_t var, const int64_t iClause, Problem& prob) {
-  _var = var;
-  _pProb = &prob;
-  const int64_t iTree = prob._vrc._N + var;
-  AVLTree &avlTr = _trees.Modify(iTree, prob.TreesShadow<taClauseSz>());
-  avlTr._iRoot = insert(_trees[iTree]._iRoot, iClause);
-  avlTr._size++;
-  _pProb = nullptr;
+template<int8_t taClauseSz, typename TIdx>
+void VarRef<taClauseSz, TIdx>::Del(const int64_t var, const int64_t iClause, TProblem &prob) {
+  const int64_t j = position(var, iClause, prob);
+  const int64_t iList = prob._vrc._N + var;
+  if (j < 0 || !Contains(var, iClause, prob)) {
+    fprintf(stderr, "Cannot find to delete variable %lld in clause %lld.\n", var, iClause);
+    __debugbreak();
+    return;
+  }
+  const int64_t at = _back[backIndex(iClause, j, prob)];
+  OccList<TIdx> &list = modList(iList, prob);
+  const int64_t iLast = list._size - 1;
+  if (at != iLast) {
+    // Move the last occurrence into the freed slot.
+    const int64_t iMoved = _slots[list._iFirst + iLast];
+    modSlot(list._iFirst + at, prob) = TIdx(iMoved);
+    modBack(backIndex(iMoved, position(var, iMoved, prob), prob), prob) = TIdx(at);
+  }
+  list._size--;
 }
 
-template<int8_t taClauseSz> void VarRef<taClauseSz>::Del(const int64_t var, const int64_t iClause, Problem& prob) {
-  _pProb = &prob;
-  _var = var;
-  const int64_t iTree = prob._vrc._N + var;
-  AVLTree &avlTr = _trees.Modify(iTree, prob.TreesShadow<taClauseSz>());
-  avlTr._iRoot = deleteNode(_trees[iTree]._iRoot, iClause);
-  avlTr._size--;
-  _pProb = nullptr;
+template<int8_t taClauseSz, typename TIdx>
+int64_t VarRef<taClauseSz, TIdx>::Size(const int64_t var, const TProblem &prob) const {
+  return _lists[prob._vrc._N + var]._size;
 }
 
-template<int8_t taClauseSz> int64_t VarRef<taClauseSz>::Size(const int64_t var, const Problem& prob) const {
-  return _trees[prob._vrc._N + var]._size;
+template<int8_t taClauseSz, typename TIdx>
+int64_t VarRef<taClauseSz, TIdx>::Occurrence(const int64_t var, const int64_t at, const TProblem &prob) const {
+  return _slots[_lists[prob._vrc._N + var]._iFirst + at];
 }
 
-template<int8_t taClauseSz> FastVector<int64_t> VarRef<taClauseSz>::Clauses(const int64_t var, Problem& prob) {
+template<int8_t taClauseSz, typename TIdx>
+FastVector<int64_t> VarRef<taClauseSz, TIdx>::Clauses(const int64_t var, const TProblem &prob) const {
   FastVector<int64_t> ans;
-  _pTraversed = &ans;
-  _pProb = &prob;
-  const int64_t iTree = prob._vrc._N + var;
-  //ans.reserve(_trees[iTree]._size);
-  traverse(_trees[iTree]._iRoot);
-  _pTraversed = nullptr;
-  _pProb = nullptr;
-  return std::move(ans);
+  const OccList<TIdx> &list = _lists[prob._vrc._N + var];
+  for (int64_t i = 0; i < list._size; i++) {
+    ans.emplace_back();
+    ans.UnshadowedModifyBack() = _slots[list._iFirst + i];
+  }
+  return ans;
 }
 
-template<int8_t taClauseSz> bool VarRef<taClauseSz>::Contains(const int64_t var, const int64_t iClause, Problem& prob) {
-  _pProb = &prob;
-  const int64_t iTree = prob._vrc._N + var;
-  bool ans = (findNode(_trees[iTree]._iRoot, iClause) >= 0);
-  _pProb = nullptr;
-  return ans;
+template<int8_t taClauseSz, typename TIdx>
+bool VarRef<taClauseSz, TIdx>::Contains(const int64_t var, const int64_t iClause, const TProblem &prob) const {
+  const int64_t j = position(var, iClause, prob);
+  if (j < 0) {
+    return false;
+  }
+  const int64_t iBack = backIndex(iClause, j, prob);
+  if (iBack >= _back.size()) {
+    return false;
+  }
+  const OccList<TIdx> &list = _lists[prob._vrc._N + var];
+  const int64_t at = _back[iBack];
+  return at >= 0 && at < list._size && _slots[list._iFirst + at] == iClause;
 }
 
-template struct VarRef<2>;
-template struct VarRef<3>;
+template struct VarRef<2, int32_t>;
+template struct VarRef<3, int32_t>;
+template struct VarRef<cClauseSzLong, int32_t>;
+template struct VarRef<2, int64_t>;
+template struct VarRef<3, int64_t>;
+template struct VarRef<cClauseSzLong, int64_t>;
@@ -1,11 +1,10 @@
 #pragma once
 
-#include "AVLTree.h"
+#include "CowVector.h"
 
-struct Problem;
+template<typename TIdx> struct Problem;
 
 struct VarRefCommon {
-  AVLNodePool _avlNp;
   int64_t _N = -1;
 
   void Init(const int64_t N) {
@@ -13,67 +12,67 @@ struct VarRefCommon {
   }
 };
 
-template<int8_t taClauseSz> struct VarRef {
-  FastVector<AVLTree> _trees;
-
-private:
-  Problem *_pProb = nullptr;
-  int64_t _var;
-  FastVector<int64_t> *_pTraversed;
-
-private:
-  AVLNode & getNode(const int64_t iNode);
-  const AVLNode & getNode(const int64_t iNode) const;
-
-  //// Taken from: https://www.geeksforgeeks.org/avl-tree-set-1-insertion/
-  // A utility function to get the height of the tree 
-  int64_t height(const int64_t iNode);
+// The occurrences of a literal: a contiguous range of slots in the arena.
+template<typename TIdx> struct OccList {
+  TIdx _iFirst;
+  TIdx _size;
+  TIdx _capacity;
+};
 
-  /* Helper function that allocates a new node with the given key and
-  NULL left and right pointers. */
-  int64_t newNode(const int64_t key);
+// The dirty bitmaps of an occurrence index.
+struct VarRefShadow {
+  FastVector<uint64_t> _lists;
+  FastVector<uint64_t> _slots;
+  FastVector<uint64_t> _back;
+};
 
-  // A utility function to right rotate subtree rooted with y 
-  // See the diagram given above. 
-  int64_t rightRotate(const int64_t y);
+// The clauses in which each literal occurs. The occurrences of a literal are stored contiguously in a flat arena,
+//   and each literal of a clause points back to its slot, so that adding and deleting an occurrence is O(1).
+// |taClauseSz| is 2 or 3 for the fixed-size clauses, or cClauseSzLong for the clauses in the literal arena.
+template<int8_t taClauseSz, typename TIdx> struct VarRef {
+  typedef Problem<TIdx> TProblem;
 
-  // A utility function to left rotate subtree rooted with x 
-  // See the diagram given above. 
-  int64_t leftRotate(const int64_t x);
+  // One per literal, at index N+var.
+  CowVector<OccList<TIdx>> _lists;
+  // The clause indices.
+  CowVector<TIdx> _slots;
+  // The slot of the literal at position j of clause i relative to the list start, at index i*taClauseSz+j, or at
+  //   the index of the literal in the arena for the long clauses.
+  CowVector<TIdx> _back;
 
-  // Get Balance factor of node N 
-  int64_t getBalance(const int64_t iNode);
+private:
+  static const int64_t _cMinCapacity = 4;
 
-  // Recursive function to insert a key in the subtree rooted 
-  // with node and returns the new root of the subtree. 
-  int64_t insert(const int64_t iNode, const int64_t key);
+  static int64_t clauseSize(const int64_t iClause, const TProblem &prob);
+  static int64_t clauseVar(const int64_t iClause, const int64_t j, const TProblem &prob);
+  static int64_t backIndex(const int64_t iClause, const int64_t j, const TProblem &prob);
+  static int64_t position(const int64_t var, const int64_t iClause, const TProblem &prob);
+  static VarRefShadow* shadow(const TProblem &prob);
 
-  void traverse(const int64_t iParent);
+  OccList<TIdx>& modList(const int64_t iList, TProblem &prob);
+  TIdx& modSlot(const int64_t iSlot, TProblem &prob);
+  TIdx& modBack(const int64_t iBack, TProblem &prob);
 
-  int64_t findNode(const int64_t iParent, const int64_t key);
+  // Moves the list to the end of the arena with twice the capacity.
+  void relocate(const int64_t iList, TProblem &prob);
 
-  /* Given a non-empty binary search tree, return the
-  node with minimum key value found in that tree.
-  Note that the entire tree does not need to be
-  searched. */
-  int64_t minValueNode(const int64_t iNode);
+public:
+  void Init(const TProblem &prob);
 
-  //// Taken from https://www.geeksforgeeks.org/avl-tree-set-2-deletion/
-  // Recursive function to delete a node with given key 
-  // from subtree with given root. It returns root of 
-  // the modified subtree. 
-  int64_t deleteNode(int64_t root, const int64_t key);
+  // Packs the lists in the arena without spare capacity, e.g. after the initial clauses are added.
+  void Compact();
 
-public:
-  void Init(const Problem &prob);
+  void Add(const int64_t var, const int64_t iClause, TProblem &prob);
 
-  void Add(const int64_t var, const int64_t iClause, Problem &prob);
+  void Del(const int64_t var, const int64_t iClause, TProblem &prob);
 
-  void Del(const int64_t var, const int64_t iClause, Problem &prob);
+  int64_t Size(const int64_t var, const TProblem &prob) const;
 
-  int64_t Size(const int64_t var, const Problem &prob) const;
+  // The index of the clause at position |at| in the list of the literal.
+  int64_t Occurrence(const int64_t var, const int64_t at, const TProblem &prob) const;
 
-  FastVector<int64_t> Clauses(const int64_t var, Problem &prob);
+  // In no particular order.
+  FastVector<int64_t> Clauses(const int64_t var, const TProblem &prob) const;
 
-  bool Contains(const int64_t var, const int64_t iClause, Problem &prob);
+  bool Contains(const int64_t var, const int64_t iClause, const TProblem &prob) const;
 };
@@ -5,22 +5,31 @@
 #include "targetver.h"
 
 #include <Windows.h>
+#include <Psapi.h>
 #undef min
 #undef max
 
 #include <immintrin.h>
 #include <intrin.h>
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
+#include <chrono>
 #include <cassert>
+#include <cmath>
 #include <condition_variable>
 #include <cstdio>
 #include <cstdint>
 #include <cstdlib>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <set>
 #include <stack>
 #include <string>
+#include <thread>
+#include <vector>